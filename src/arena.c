@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "osmem.h"
+
+/* Largest chunk, so that os_malloc's block for it doesn't wrap around */
+#define ARENA_MAX_CHUNK (MAX_PAYLOAD_SIZE - sizeof(os_arena_chunk_t))
+
+static os_arena_chunk_t *new_chunk(size_t size)
+{
+	os_arena_chunk_t *chunk = os_malloc(sizeof(*chunk) + size);
+
+	if (!chunk)
+		return NULL;
+
+	chunk->next = NULL;
+	chunk->size = size;
+	return chunk;
+}
+
+static void use_chunk(os_arena_t *arena, os_arena_chunk_t *chunk)
+{
+	chunk->next = arena->chunk;
+	arena->chunk = chunk;
+	arena->ptr = (char *)(chunk + 1);
+	arena->end = arena->ptr + chunk->size;
+	arena->capacity += chunk->size;
+}
+
+static void free_chunks(os_arena_t *arena)
+{
+	os_arena_chunk_t *chunk = arena->chunk;
+
+	while (chunk) {
+		os_arena_chunk_t *next = chunk->next;
+
+		os_free(chunk);
+		chunk = next;
+	}
+
+	arena->chunk = NULL;
+	arena->capacity = 0;
+}
+
+os_arena_t *os_arena_create(size_t initial_size)
+{
+	if (initial_size > ARENA_MAX_CHUNK) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	os_arena_t *arena = os_malloc(sizeof(*arena));
+
+	if (!arena)
+		return NULL;
+
+	if (!initial_size)
+		initial_size = ARENA_DEFAULT_SIZE;
+
+	os_arena_chunk_t *chunk = new_chunk(initial_size);
+
+	if (!chunk) {
+		os_free(arena);
+		return NULL;
+	}
+
+	arena->chunk = NULL;
+	arena->capacity = 0;
+	use_chunk(arena, chunk);
+
+	return arena;
+}
+
+void *os_arena_alloc(os_arena_t *arena, size_t size, size_t align)
+{
+	if (!align)
+		align = ALIGNMENT;
+
+	if (align & (align - 1)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* The chunk for it, header and alignment included, would wrap around */
+	if (align > ARENA_MAX_CHUNK || size > ARENA_MAX_CHUNK - align) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	/* The fast path: one pointer bump in the current chunk */
+	uintptr_t p = ((uintptr_t)arena->ptr + align - 1) & ~(uintptr_t)(align - 1);
+
+	if (p <= (uintptr_t)arena->end && size <= (size_t)(arena->end - (char *)p)) {
+		arena->ptr = (char *)p + size;
+		return (void *)p;
+	}
+
+	/* The current chunk is full, the next one is at least twice as big, so
+	 * the number of chunks stays logarithmic in the arena's size
+	 */
+	size_t chunk_size = arena->chunk->size > ARENA_MAX_CHUNK / 2 ?
+			    ARENA_MAX_CHUNK : 2 * arena->chunk->size;
+
+	if (chunk_size < size + align)
+		chunk_size = size + align;
+
+	os_arena_chunk_t *chunk = new_chunk(chunk_size);
+
+	if (!chunk)
+		return NULL;
+
+	use_chunk(arena, chunk);
+
+	p = ((uintptr_t)arena->ptr + align - 1) & ~(uintptr_t)(align - 1);
+	arena->ptr = (char *)p + size;
+	return (void *)p;
+}
+
+void os_arena_reset(os_arena_t *arena)
+{
+	/* A single chunk is just rewound */
+	if (!arena->chunk->next) {
+		arena->ptr = (char *)(arena->chunk + 1);
+		return;
+	}
+
+	/* Otherwise the chunks are replaced by one chunk big enough for all of
+	 * them, so the next cycle of the same size won't overflow
+	 */
+	size_t capacity = arena->capacity > ARENA_MAX_CHUNK ? ARENA_MAX_CHUNK : arena->capacity;
+
+	free_chunks(arena);
+
+	os_arena_chunk_t *chunk = new_chunk(capacity);
+
+	DIE(!chunk, "arena: failed to allocate a chunk\n");
+	use_chunk(arena, chunk);
+}
+
+void os_arena_destroy(os_arena_t *arena)
+{
+	if (!arena)
+		return;
+
+	free_chunks(arena);
+	os_free(arena);
+}
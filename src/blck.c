@@ -1,71 +1,262 @@
 // SPDX-License-Identifier: BSD-3-Clause
 
+#define _GNU_SOURCE
 #include "blck.h"
 
-void set_list_head(block_meta_t *block)
+/* Quick lists of the deferred coalescing mode */
+static block_meta_t *quick_bins[QUICK_BINS];
+static size_t quick_bytes;
+
+/* Where the last next fit search stopped */
+static block_meta_t *rover;
+
+/* Extra capacity given to growing blocks since the last reclaim */
+static size_t headroom_bytes;
+
+/* Segment of the main heap, when it doesn't use the program break */
+static heap_segment_t *heap_segment;
+
+/* Free heap blocks whose whole pages may be committed, for the decay purger.
+ * The node sits at the start of the block's payload, and the blocks are
+ * linked the oldest first
+ */
+struct heap_lru_node {
+	uint32_t epoch;		/* Decay epoch the block got dirty in */
+	uint32_t pages;		/* Whole pages counted in heap_dirty_bytes */
+	block_meta_t *prev;
+	block_meta_t *next;
+};
+
+static block_meta_t *lru_head, *lru_tail;
+
+#define HEAP_DIRTY_FLAGS (BLOCK_FLAG_DIRTY | BLOCK_FLAG_LRU)
+
+/* Heap blocks always have their header inline, the header of a block being
+ * built can't be read yet
+ */
+static struct heap_lru_node *lru_node(block_meta_t *block)
 {
-	head = block;
+	return (struct heap_lru_node *)((char *)block + BLOCK_ALIGN);
 }
 
-block_meta_t *get_last_heap(void)
+/* Whole pages inside a free heap block, past it's header and node */
+static void heap_dirty_range(block_meta_t *block, char **start, char **end)
 {
-	if (!head)
-		return NULL;
+	char *payload = (char *)lru_node(block);
 
-	block_meta_t *iter = head;
+	*start = (char *)PAGE_ALIGN((uintptr_t)payload + sizeof(struct heap_lru_node));
+	*end = (char *)(((uintptr_t)payload + get_raw_size(block)) & ~(uintptr_t)(PAGE_SIZE - 1));
+	if (*end < *start)
+		*end = *start;
+}
 
-	while (iter->next)
-		iter = iter->next;
+static size_t heap_dirty_pages(block_meta_t *block)
+{
+	char *start, *end;
 
-	/* If last block is mapped, then there are no heap blocks */
-	if (iter->status == STATUS_MAPPED)
-		return NULL;
+	heap_dirty_range(block, &start, &end);
+	return (end - start) / PAGE_SIZE;
+}
 
-	return iter;
+/* Link a dirty block as the youngest, if it holds whole pages */
+static void lru_push(block_meta_t *block)
+{
+	size_t pages = heap_dirty_pages(block);
+
+	if (!pages)
+		return;
+
+	struct heap_lru_node *node = lru_node(block);
+
+	node->epoch = decay_epoch;
+	node->pages = pages;
+	node->prev = lru_tail;
+	node->next = NULL;
+	if (lru_tail)
+		lru_node(lru_tail)->next = block;
+	else
+		lru_head = block;
+	lru_tail = block;
+
+	block->flags |= BLOCK_FLAG_LRU;
+	mem_stats.heap_dirty_bytes += pages * PAGE_SIZE;
 }
 
-block_meta_t *get_heap_start(void)
+/* Unlink a block, it stays dirty */
+static void lru_unlink(block_meta_t *block)
 {
-	if (!head)
-		return NULL;
+	if (!(block->flags & BLOCK_FLAG_LRU))
+		return;
 
-	block_meta_t *iter = head;
+	struct heap_lru_node *node = lru_node(block);
 
-	while (iter) {
-		if (iter->status == STATUS_ALLOC)
-			return iter;
+	if (node->prev)
+		lru_node(node->prev)->next = node->next;
+	else
+		lru_head = node->next;
+	if (node->next)
+		lru_node(node->next)->prev = node->prev;
+	else
+		lru_tail = node->prev;
 
-		iter = iter->next;
+	block->flags &= ~BLOCK_FLAG_LRU;
+	mem_stats.heap_dirty_bytes -= node->pages * PAGE_SIZE;
+}
+
+/* Give the place of a linked block in the LRU to another block */
+static void lru_move(block_meta_t *from, block_meta_t *to)
+{
+	struct heap_lru_node *node = lru_node(to);
+
+	*node = *lru_node(from);
+	if (node->prev)
+		lru_node(node->prev)->next = to;
+	else
+		lru_head = to;
+	if (node->next)
+		lru_node(node->next)->prev = to;
+	else
+		lru_tail = to;
+
+	from->flags &= ~BLOCK_FLAG_LRU;
+	to->flags |= BLOCK_FLAG_LRU;
+}
+
+/* Count the pages of a linked block again, after it's size changed */
+static void lru_recount(block_meta_t *block)
+{
+	if (!(block->flags & BLOCK_FLAG_LRU))
+		return;
+
+	struct heap_lru_node *node = lru_node(block);
+	size_t pages = heap_dirty_pages(block);
+
+	if (!pages) {
+		lru_unlink(block);
+		return;
 	}
 
-	return NULL;
+	mem_stats.heap_dirty_bytes += (pages - node->pages) * PAGE_SIZE;
+	node->pages = pages;
 }
 
-block_meta_t *get_last_mmap(void)
+/* A free heap block that was just given back holds dirty memory */
+static void heap_lru_freed(block_meta_t *block)
 {
-	/* If Memory List is empty */
-	if (!head)
-		return NULL;
+	if (!decay_enabled)
+		return;
 
-	/* If Memory List doesn't contain any maped block */
-	if (head->status == STATUS_ALLOC)
-		return NULL;
+	block->flags = (block->flags & ~BLOCK_FLAG_LRU) | BLOCK_FLAG_DIRTY;
+	lru_push(block);
+}
 
-	/* Find the last maped block */
-	block_meta_t *iter = head;
+/* A free heap block is about to hold user data */
+static void heap_lru_taken(block_meta_t *block)
+{
+	lru_unlink(block);
+	block->flags &= ~HEAP_DIRTY_FLAGS;
+}
 
-	while (iter->next != NULL) {
-		if (iter->next->status == STATUS_ALLOC)
-			break;
+/* Decay state of the block split off the end of another one, before any of
+ * their headers change. The rest of a free block keeps it's state and it's
+ * place in the LRU, the memory given back by a shrinking block is dirty
+ */
+static int heap_lru_split(block_meta_t *block, block_meta_t *rest)
+{
+	if (!decay_enabled)
+		return 0;
+
+	if (block->status != STATUS_FREE)
+		return BLOCK_FLAG_DIRTY;
+
+	int flags = block->flags & HEAP_DIRTY_FLAGS;
+	uintptr_t start = PAGE_ALIGN((uintptr_t)lru_node(rest) + sizeof(struct heap_lru_node));
+	uintptr_t end = (uintptr_t)lru_node(block) + get_raw_size(block);
+
+	/* A rest without whole pages may be too small for the node */
+	if (end - start < PAGE_SIZE || end < start) {
+		lru_unlink(block);
+		flags &= ~BLOCK_FLAG_LRU;
+	} else if (flags & BLOCK_FLAG_LRU) {
+		lru_move(block, rest);
+	}
+	block->flags &= ~HEAP_DIRTY_FLAGS;
 
-		iter = iter->next;
+	return flags;
+}
+
+/* Settle the decay state of a block whose size changed */
+static void heap_lru_settle(block_meta_t *block)
+{
+	if (block->flags & BLOCK_FLAG_LRU)
+		lru_recount(block);
+	else if (block->flags & BLOCK_FLAG_DIRTY)
+		lru_push(block);
+}
+
+/* Decay state of two merged heap blocks. Clean parts make a clean block, the
+ * merged block keeps the place of it's youngest linked part, and it starts
+ * over if a dirty part of unknown age joins
+ */
+static void heap_lru_merge(block_meta_t *block, block_meta_t *gone)
+{
+	if (!decay_enabled)
+		return;
+
+	/* The memory of the merged block goes to the user */
+	if (block->status != STATUS_FREE || gone->status != STATUS_FREE) {
+		heap_lru_taken(block);
+		heap_lru_taken(gone);
+		return;
 	}
 
-	return iter;
+	if (!((block->flags | gone->flags) & BLOCK_FLAG_DIRTY))
+		return;
+
+	int untracked = (block->flags & HEAP_DIRTY_FLAGS) == BLOCK_FLAG_DIRTY ||
+			(gone->flags & HEAP_DIRTY_FLAGS) == BLOCK_FLAG_DIRTY;
+
+	if (block->flags & gone->flags & BLOCK_FLAG_LRU) {
+		if ((int32_t)(lru_node(gone)->epoch - lru_node(block)->epoch) < 0)
+			lru_unlink(gone);
+		else
+			lru_unlink(block);
+	}
+
+	if (gone->flags & BLOCK_FLAG_LRU)
+		lru_move(gone, block);
+	gone->flags &= ~HEAP_DIRTY_FLAGS;
+	block->flags |= BLOCK_FLAG_DIRTY;
+
+	if (untracked)
+		lru_unlink(block);
+	heap_lru_settle(block);
+}
+
+void set_list_head(block_meta_t *block)
+{
+	head = block;
+}
+
+block_meta_t *get_last_heap(void)
+{
+	return get_last_block();
+}
+
+block_meta_t *get_heap_start(void)
+{
+	if (metadir_enabled)
+		return metadir_first();
+
+	/* Mapped blocks are kept out of the Memory List */
+	return head;
 }
 
 block_meta_t *get_last_block(void)
 {
+	if (metadir_enabled)
+		return metadir_last();
+
 	if (!head)
 		return NULL;
 
@@ -79,31 +270,7 @@ block_meta_t *get_last_block(void)
 
 void insert_mmaped_block(block_meta_t *block)
 {
-	/* When the list is empty, set it's head */
-	if (!head) {
-		set_list_head(block);
-		return;
-	}
-
-	block_meta_t *last_mapped = get_last_mmap();
-
-	/* If last_mapped is NULL, then there is no mapped block in the list */
-	if (!last_mapped) {
-		/* Make it the head */
-		block->prev = NULL;
-		block->next = head;
-		head->prev = block;
-		head = block;
-		return;
-	}
-
-	block_meta_t *first_allocd = last_mapped->next;
-
-	block->prev = last_mapped;
-	block->next = first_allocd;
-	last_mapped->next = block;
-	if (first_allocd)
-		first_allocd->prev = block;
+	mapped_insert(block);
 }
 
 void insert_heap_block(block_meta_t *block)
@@ -111,6 +278,7 @@ void insert_heap_block(block_meta_t *block)
 	/* When the list is empty, set it's head */
 	if (!head) {
 		set_list_head(block);
+		metadir_insert(block);
 		return;
 	}
 
@@ -120,11 +288,13 @@ void insert_heap_block(block_meta_t *block)
 	block->next = NULL;
 	block->prev = last_block;
 	last_block->next = block;
+	metadir_insert(block);
 }
 
 void add_block(block_meta_t *block)
 {
-	if (block->status == STATUS_ALLOC)
+	/* The preallocated zone is a free heap block */
+	if (block->status != STATUS_MAPPED)
 		insert_heap_block(block);
 	else
 		insert_mmaped_block(block);
@@ -146,6 +316,7 @@ block_meta_t *split_block(block_meta_t *unused_block, size_t payload_size)
 	/* Get a pointer to the resulting free block */
 	void *p = (void *)((char *)unused_block + raw_chunk);
 	block_meta_t *free_block = (block_meta_t *)p;
+	int decay_flags = heap_lru_split(unused_block, free_block);
 
 	/* Set the fields of the allocated chunk */
 	unused_block->size = payload_size;
@@ -154,6 +325,7 @@ block_meta_t *split_block(block_meta_t *unused_block, size_t payload_size)
 	/* Set the fields of the remaining free zone */
 	free_block->size = ALIGN(free_memory - BLOCK_ALIGN);
 	free_block->status = STATUS_FREE;
+	free_block->flags = decay_flags;
 
 	/* Make the connections for the resulting free block */
 	free_block->prev = unused_block;
@@ -165,14 +337,28 @@ block_meta_t *split_block(block_meta_t *unused_block, size_t payload_size)
 
 	unused_block->next = free_block;
 
+	metadir_update(unused_block);
+	metadir_insert(free_block);
+	heap_lru_settle(free_block);
+
 	return free_block;
 }
 
 void extract_block(block_meta_t *block)
 {
+	if (block->status == STATUS_MAPPED) {
+		/* Long lived blocks are only in the long lived heap */
+		if (!(block->flags & BLOCK_FLAG_LONG))
+			mapped_remove(block);
+		return;
+	}
+
 	block_meta_t *prev = block->prev;
 	block_meta_t *next = block->next;
 
+	if (rover == block)
+		rover = NULL;
+
 	/* If prev is NULL and next is NULL, then the block is the only block in
 	 * Memory List: In this case,  we just reset the head
 	 */
@@ -206,11 +392,52 @@ void extract_block(block_meta_t *block)
 	block->next = NULL;
 }
 
+static block_meta_t *find_next_fit(size_t size)
+{
+	if (metadir_enabled) {
+		block_meta_t *block = metadir_find_from(size, rover);
+
+		if (block)
+			rover = block;
+		return block;
+	}
+
+	block_meta_t *start = rover ? rover : head;
+	block_meta_t *iterator = start;
+
+	/* Go around the list once, starting from the rover */
+	do {
+		if (iterator->status == STATUS_FREE && ALIGN(iterator->size) >= ALIGN(size)) {
+			rover = iterator;
+			return iterator;
+		}
+
+		iterator = iterator->next ? iterator->next : head;
+	} while (iterator != start);
+
+	return NULL;
+}
+
 block_meta_t *find_best_block(size_t size)
 {
 	block_meta_t *return_block = NULL;
 	block_meta_t *iterator = head;
 
+	if (!head)
+		return NULL;
+
+	if (placement_policy == PLACEMENT_NEXT)
+		return find_next_fit(size);
+
+	/* Blocks up to this size are good enough to stop the search */
+	size_t good_size = ALIGN(size);
+
+	if (placement_policy == PLACEMENT_GOOD)
+		good_size += ALIGN(size) * good_fit_percent / 100;
+
+	if (metadir_enabled)
+		return metadir_find(size, good_size, placement_policy == PLACEMENT_FIRST);
+
 	while (iterator) {
 		/* If the chunk isn't marked as free, skip */
 		if (iterator->status != STATUS_FREE) {
@@ -224,8 +451,8 @@ block_meta_t *find_best_block(size_t size)
 			continue;
 		}
 
-		/* If it finds a perfect block */
-		if (ALIGN(iterator->size) == ALIGN(size))
+		/* If it finds a perfect block, or the first block, in first fit */
+		if (ALIGN(iterator->size) <= good_size || placement_policy == PLACEMENT_FIRST)
 			return iterator;
 
 		/* If it finds the first fitting zone */
@@ -248,40 +475,138 @@ block_meta_t *find_best_block(size_t size)
 	return return_block;
 }
 
+void *heap_sbrk(size_t size)
+{
+	if (!heap_reserve) {
+		void *p = sbrk(size);
+
+		if (p != MAP_FAILED)
+			stats_heap_grown(size);
+		return p;
+	}
+
+	if (!heap_segment)
+		heap_segment = segment_create(heap_reserve);
+	if (!heap_segment)
+		return MAP_FAILED;
+
+	void *p = segment_sbrk(heap_segment, size);
+
+	if (p != MAP_FAILED)
+		mem_stats.heap_bytes += size;
+	return p;
+}
+
+void *heap_end(void)
+{
+	if (!heap_reserve)
+		return sbrk(0);
+
+	return heap_segment ? heap_segment->brk : NULL;
+}
+
 void *alloc_raw_memory(size_t raw_size, alloc_type_t syscall_type)
 {
 	void *p;
 
 	if (syscall_type == BRK)
-		p = sbrk(raw_size);
+		p = heap_sbrk(raw_size);
 	else
 		p = mmap(NULL, raw_size, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
 
 	if (p == MAP_FAILED)
 		return NULL;
 
+	if (syscall_type == MMAP)
+		stats_mapped(raw_size);
+
 	return p;
 }
 
+/* Mapped block whose header lives in the header pool, so the payload starts
+ * the mapping and no page is spent on the header alone
+ */
+static block_meta_t *alloc_out_of_line_block(size_t payload_size)
+{
+	block_meta_t *block = mapped_header_alloc();
+
+	if (!block)
+		return NULL;
+
+	void *p = alloc_raw_memory(PAGE_ALIGN(payload_size), MMAP);
+
+	if (!p) {
+		mapped_header_free(block);
+		return NULL;
+	}
+
+	block->size = payload_size;
+	block->status = STATUS_MAPPED;
+	block->flags = BLOCK_FLAG_OUT_OF_LINE;
+	block->prev = p;
+	block->next = NULL;
+
+	return block;
+}
+
+block_meta_t *alloc_span_block(size_t payload_size)
+{
+	size_t pages = PAGE_ALIGN(BLOCK_ALIGN + ALIGN(payload_size)) / PAGE_SIZE;
+	block_meta_t *block = span_alloc(pages);
+
+	if (!block)
+		return NULL;
+
+	block->size = payload_size;
+	block->status = STATUS_MAPPED;
+	block->flags = BLOCK_FLAG_SPAN;
+	block->prev = NULL;
+	block->next = NULL;
+
+	return block;
+}
+
+/* Offset of a new mapped block in it's mapping. The colours rotate over
+ * the cache lines that fit in the slack of the last page
+ */
+static size_t next_color_offset(size_t raw_size)
+{
+	static size_t color;
+	size_t colors = (PAGE_ALIGN(raw_size) - raw_size) / CACHE_LINE_SIZE + 1;
+
+	return (color++ % colors) * CACHE_LINE_SIZE;
+}
+
 block_meta_t *alloc_new_block(size_t payload_size, size_t limit)
 {
 	/* Calculated the raw memory size that will be used for the payload */
 	size_t raw_size = BLOCK_ALIGN + ALIGN(payload_size);
 
+	if (raw_size > limit && page_aligned_maps)
+		return alloc_out_of_line_block(payload_size);
+
 	/* Get the memory using either sbrk or mmap, depending on required size */
 	void *p;
+	size_t offset = 0;
+	unsigned int flags = 0;
 
-	if (raw_size <= limit)
+	if (raw_size <= limit) {
 		p = alloc_raw_memory(raw_size, BRK);
-	else
-		p = alloc_raw_memory(raw_size, MMAP);
+	} else if (buddy_fits(raw_size) && (p = buddy_alloc(raw_size))) {
+		flags = BLOCK_FLAG_BUDDY;
+	} else {
+		/* The mapping covers the colour offset, it takes no extra page */
+		if (cache_color)
+			offset = next_color_offset(raw_size);
+		p = alloc_raw_memory(offset + raw_size, MMAP);
+	}
 
 	/* If something went wrong return NULL */
 	if (!p)
 		return NULL;
 
 	/* Make the header of the zone */
-	block_meta_t *block = (block_meta_t *)p;
+	block_meta_t *block = (block_meta_t *)((char *)p + offset);
 
 	block->size = payload_size;
 
@@ -291,6 +616,7 @@ block_meta_t *alloc_new_block(size_t payload_size, size_t limit)
 	else
 		block->status = STATUS_MAPPED;
 
+	block->flags = flags;
 	block->prev = NULL;
 	block->next = NULL;
 
@@ -300,7 +626,7 @@ block_meta_t *alloc_new_block(size_t payload_size, size_t limit)
 block_meta_t *prealloc_heap(void)
 {
 	/* Get a relative big chunk of memory generated by sbrk */
-	void *p = alloc_raw_memory(HEAP_PREALLOCATION_SIZE, BRK);
+	void *p = alloc_raw_memory(heap_prealloc_size, BRK);
 
 	if (!p)
 		return NULL;
@@ -308,22 +634,93 @@ block_meta_t *prealloc_heap(void)
 	block_meta_t *preallocated_zone = (block_meta_t *)p;
 
 	/* The free space of the zone will not be exactly 128 bytes */
-	preallocated_zone->size = HEAP_PREALLOCATION_SIZE - BLOCK_ALIGN;
+	preallocated_zone->size = heap_prealloc_size - BLOCK_ALIGN;
 	preallocated_zone->status = STATUS_FREE;
+	preallocated_zone->flags = 0;
 
 	return preallocated_zone;
 }
 
 void *expand_heap(size_t size)
 {
-	void *p = sbrk(size);
+	void *p = heap_sbrk(size);
 
 	if (p == MAP_FAILED)
 		return NULL;
 
+	metadir_grown();
 	return p;
 }
 
+size_t heap_growth_step(size_t min_size)
+{
+	/* Growth step used by the last expansion, and the allocated bytes
+	 * counter at that moment
+	 */
+	static size_t step;
+	static size_t alloc_mark;
+
+	size_t allocated = mem_stats.heap_alloc_bytes - alloc_mark;
+
+	if (!step) {
+		step = heap_growth_min;
+	} else if (allocated < 2 * step) {
+		/* The last step was used up quickly, the demand is high */
+		step = step * 2 < heap_growth_max ? step * 2 : heap_growth_max;
+	} else if (allocated > 8 * step) {
+		/* The heap mostly reuses blocks, grow it in smaller steps */
+		step = step / 2 > heap_growth_min ? step / 2 : heap_growth_min;
+	}
+
+	alloc_mark = mem_stats.heap_alloc_bytes;
+
+	/* Grow proportionally to the biggest heap the program needed so far */
+	size_t grow = step;
+
+	if (grow < mem_stats.peak_heap_live_bytes / 8)
+		grow = mem_stats.peak_heap_live_bytes / 8;
+	if (grow > heap_growth_max)
+		grow = heap_growth_max;
+
+	grow = (grow + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1);
+	if (grow < min_size)
+		grow = ALIGN(min_size);
+
+	mem_stats.heap_growth_step = grow;
+
+	return grow;
+}
+
+block_meta_t *grow_heap(size_t min_size)
+{
+	block_meta_t *tail = get_last_heap();
+
+	if (!tail)
+		return NULL;
+
+	size_t grow = heap_growth_step(min_size);
+	void *p = expand_heap(grow);
+
+	if (!p)
+		return NULL;
+
+	/* A free tail just gets bigger */
+	if (tail->status == STATUS_FREE) {
+		tail->size = get_raw_size(tail);
+		return tail;
+	}
+
+	/* Otherwise, the new memory becomes a free block at the end */
+	block_meta_t *block = (block_meta_t *)p;
+
+	block->size = grow - BLOCK_ALIGN;
+	block->status = STATUS_FREE;
+	block->flags = 0;
+	insert_heap_block(block);
+
+	return block;
+}
+
 block_meta_t *reuse_block(size_t size)
 {
 	/* If list is empty */
@@ -332,7 +729,7 @@ block_meta_t *reuse_block(size_t size)
 
 	size_t raw_size = BLOCK_ALIGN + ALIGN(size);
 
-	if (raw_size > MMAP_THRESHOLD)
+	if (raw_size > mmap_threshold)
 		return NULL;
 
 	/* Get the tail of the list, to expand it if possible */
@@ -344,6 +741,37 @@ block_meta_t *reuse_block(size_t size)
 	/* Find a fitting block */
 	block_meta_t *block = find_best_block(size);
 
+	/* A miss is the moment to coalesce the blocks whose merging was
+	 * deferred. The tail may have been merged as well
+	 */
+	if (!block && quick_bytes) {
+		consolidate_quick();
+		block = find_best_block(size);
+		tail = get_last_heap();
+	}
+
+	/* Before the heap grows, the headroom of the growing blocks is
+	 * given back
+	 */
+	if (!block && headroom_bytes) {
+		reclaim_headroom();
+		block = find_best_block(size);
+		tail = get_last_heap();
+	}
+
+	/* In adaptive mode, the heap grows by a whole step, and the block is
+	 * taken from the resulting free tail
+	 */
+	if (!block && heap_adaptive) {
+		size_t missing = raw_size;
+
+		if (tail->status == STATUS_FREE)
+			missing = ALIGN(size) - ALIGN(tail->size);
+
+		block = grow_heap(missing);
+		DIE(!block, "failed to expand the heap\n");
+	}
+
 	/* If nothing was found, and the tail isn't free, there's nothing
 	 * to do
 	 */
@@ -357,23 +785,96 @@ block_meta_t *reuse_block(size_t size)
 		void *new_zone = expand_heap(ALIGN(size) - ALIGN(tail->size));
 
 		DIE(!new_zone, "failed to expand the heap\n");
+		heap_lru_taken(ptr);
 		ptr->size = size;
 		ptr->status = STATUS_ALLOC;
+		metadir_update(ptr);
 		return ptr;
 	}
 
 	/* If it found a perfect sized block */
 	if (block->size == size) {
+		heap_lru_taken(block);
 		block->status = STATUS_ALLOC;
+		metadir_update(block);
 		return block;
 	}
 
 	/* If the block can't be splitted, just set it's status */
-	if (get_raw_reusable_memory(block, size) < MIN_SPACE) {
+	if (get_raw_reusable_memory(block, size) < split_threshold) {
+		heap_lru_taken(block);
+		block->status = STATUS_ALLOC;
+		metadir_update(block);
+		return block;
+	}
+
+	split_block(block, size);
+	return block;
+}
+
+block_meta_t *split_block_high(block_meta_t *unused_block, size_t payload_size)
+{
+	size_t capacity = get_raw_size(unused_block);
+	size_t raw_chunk = BLOCK_ALIGN + ALIGN(payload_size);
+
+	/* The allocated chunk takes the end of the free block */
+	void *p = (void *)((char *)get_address_by_block(unused_block) + capacity - raw_chunk);
+	block_meta_t *alloc_block = (block_meta_t *)p;
+
+	/* The new header may cover the node of a block left without pages */
+	if (capacity - raw_chunk < PAGE_SIZE)
+		lru_unlink(unused_block);
+
+	alloc_block->size = payload_size;
+	alloc_block->status = STATUS_ALLOC;
+	alloc_block->flags = 0;
+
+	alloc_block->prev = unused_block;
+	alloc_block->next = unused_block->next;
+
+	if (unused_block->next)
+		unused_block->next->prev = alloc_block;
+
+	unused_block->next = alloc_block;
+	unused_block->size = capacity - raw_chunk;
+
+	metadir_insert(alloc_block);
+	lru_recount(unused_block);
+
+	return alloc_block;
+}
+
+block_meta_t *place_by_lifetime(size_t size, int long_lived)
+{
+	block_meta_t *block = NULL;
+
+	if (metadir_enabled) {
+		block = long_lived ? metadir_find(size, 0, 1) : metadir_find_last(size);
+	} else if (long_lived) {
+		/* Long lived blocks are packed at the bottom of the heap */
+		for (block_meta_t *iter = get_heap_start(); iter && !block; iter = iter->next)
+			if (iter->status == STATUS_FREE && ALIGN(iter->size) >= ALIGN(size))
+				block = iter;
+	} else {
+		/* Short lived ones go as high as possible, next to the tail */
+		for (block_meta_t *iter = get_last_heap(); iter && !block; iter = iter->prev)
+			if (iter->status == STATUS_FREE && ALIGN(iter->size) >= ALIGN(size))
+				block = iter;
+	}
+
+	if (!block)
+		return NULL;
+
+	if (get_raw_reusable_memory(block, size) < split_threshold) {
+		heap_lru_taken(block);
 		block->status = STATUS_ALLOC;
+		metadir_update(block);
 		return block;
 	}
 
+	if (!long_lived)
+		return split_block_high(block, size);
+
 	split_block(block, size);
 	return block;
 }
@@ -387,6 +888,78 @@ void mark_freed(block_meta_t *block)
 	block->size = get_raw_size(block);
 
 	block->status = STATUS_FREE;
+	block->flags &= ~BLOCK_FLAG_GROWING;
+	metadir_update(block);
+
+	decay_freed(block->size / PAGE_SIZE);
+	heap_lru_freed(block);
+}
+
+int quick_push(block_meta_t *block)
+{
+	size_t capacity = get_raw_size(block);
+
+	if (capacity > QUICK_MAX_SIZE)
+		return 0;
+
+	block->flags &= ~BLOCK_FLAG_GROWING;
+
+	/* The payload is left untouched, the size field holds the link */
+	block->size = (size_t)quick_bins[capacity / ALIGNMENT];
+	block->status = STATUS_QUICK;
+	metadir_update(block);
+	quick_bins[capacity / ALIGNMENT] = block;
+	quick_bytes += capacity;
+	mem_stats.quick_frees++;
+
+	/* Too much memory is held back from coalescing */
+	if (quick_bytes > quick_max_bytes)
+		consolidate_quick();
+
+	return 1;
+}
+
+block_meta_t *quick_pop(size_t size)
+{
+	size_t bin = ALIGN(size) / ALIGNMENT;
+
+	if (bin >= QUICK_BINS || !quick_bins[bin])
+		return NULL;
+
+	block_meta_t *block = quick_bins[bin];
+
+	quick_bins[bin] = (block_meta_t *)block->size;
+	quick_bytes -= bin * ALIGNMENT;
+	mem_stats.quick_hits++;
+
+	block->size = size;
+	block->status = STATUS_ALLOC;
+	metadir_update(block);
+
+	return block;
+}
+
+void consolidate_quick(void)
+{
+	for (size_t i = 0; i < QUICK_BINS; i++) {
+		block_meta_t *block = quick_bins[i];
+
+		while (block) {
+			block_meta_t *next = (block_meta_t *)block->size;
+
+			block->size = i * ALIGNMENT;
+			block->status = STATUS_FREE;
+			metadir_update(block);
+			heap_lru_freed(block);
+			merge_free_blocks(block);
+			block = next;
+		}
+
+		quick_bins[i] = NULL;
+	}
+
+	quick_bytes = 0;
+	mem_stats.quick_consolidations++;
 }
 
 void merge_with_next(block_meta_t *block)
@@ -414,6 +987,11 @@ void merge_with_next(block_meta_t *block)
 
 	block->next = new_next;
 	block->size = new_size;
+	metadir_remove(next);
+	heap_lru_merge(block, next);
+
+	if (rover == next)
+		rover = block;
 }
 
 void merge_with_prev(block_meta_t *block)
@@ -438,6 +1016,11 @@ void merge_with_prev(block_meta_t *block)
 
 	prev->next = new_next;
 	prev->size = new_size;
+	metadir_remove(block);
+	heap_lru_merge(prev, block);
+
+	if (rover == block)
+		rover = prev;
 }
 
 void merge_free_blocks(block_meta_t *block)
@@ -446,11 +1029,130 @@ void merge_free_blocks(block_meta_t *block)
 	merge_with_prev(block);
 }
 
+block_meta_t *heap_oldest_dirty(uint32_t *epoch)
+{
+	if (lru_head)
+		*epoch = lru_node(lru_head)->epoch;
+
+	return lru_head;
+}
+
+void heap_take_dirty(block_meta_t *block, purge_extent_t *ext)
+{
+	char *start, *end;
+
+	heap_dirty_range(block, &start, &end);
+
+	/* It looks allocated to the rest of the heap until it comes back */
+	heap_lru_taken(block);
+	block->status = STATUS_ALLOC;
+	metadir_update(block);
+
+	ext->addr = start;
+	ext->len = end - start;
+	ext->source = DECAY_SOURCE_HEAP;
+	ext->cookie = block;
+	ext->run = 0;
+}
+
+void heap_put_clean(purge_extent_t *ext)
+{
+	block_meta_t *block = ext->cookie;
+
+	block->status = STATUS_FREE;
+	metadir_update(block);
+	merge_free_blocks(block);
+}
+
+/* Colour offset of an inline mapped block, the mappings are page aligned */
+static size_t color_offset(block_meta_t *block)
+{
+	return (uintptr_t)block & (PAGE_SIZE - 1);
+}
+
+size_t get_mapped_length(block_meta_t *block)
+{
+	if (block->flags & BLOCK_FLAG_OUT_OF_LINE)
+		return PAGE_ALIGN(block->size);
+
+	if (block->flags & BLOCK_FLAG_BUDDY)
+		return buddy_block_size(block);
+
+	if (block->flags & BLOCK_FLAG_SPAN)
+		return PAGE_ALIGN(BLOCK_ALIGN + ALIGN(block->size));
+
+	if (block->flags & BLOCK_FLAG_LONG)
+		return BLOCK_ALIGN + long_capacity(block);
+
+	return color_offset(block) + BLOCK_ALIGN + ALIGN(block->size);
+}
+
+void *get_mapping_start(block_meta_t *block)
+{
+	if (block->flags & BLOCK_FLAG_OUT_OF_LINE)
+		return block->prev;
+
+	if (block->flags & BLOCK_FLAG_LONG)
+		return block;
+
+	return (char *)block - color_offset(block);
+}
+
 int free_mmaped_block(block_meta_t *block)
 {
-	size_t length = BLOCK_ALIGN + ALIGN(block->size);
+	if (block->flags & BLOCK_FLAG_BUDDY) {
+		buddy_free(block, BLOCK_ALIGN + ALIGN(block->size));
+		return 0;
+	}
+
+	if (block->flags & BLOCK_FLAG_SPAN) {
+		span_free(block);
+		return 0;
+	}
+
+	if (block->flags & BLOCK_FLAG_LONG) {
+		long_free(block);
+		return 0;
+	}
+
+	/* An inline header is gone with the mapping */
+	int out_of_line = block->flags & BLOCK_FLAG_OUT_OF_LINE;
+	size_t length = get_mapped_length(block);
+	void *start = get_mapping_start(block);
+	int ret = reclaim_enabled ? reclaim_unmap(start, length) : munmap(start, length);
+
+	if (ret < 0)
+		return ret;
+
+	/* A queued mapping is counted by the reclaimer's munmap */
+	if (ret)
+		stats_unmap_queued(length);
+	else
+		stats_unmapped(length);
+	if (out_of_line)
+		mapped_header_free(block);
+
+	return 0;
+}
+
+void update_mmap_threshold(block_meta_t *block)
+{
+	size_t raw_size = BLOCK_ALIGN + ALIGN(block->size);
+
+	/* Buddy, span and long lived blocks are recycled without any syscall,
+	 * serving their sizes from the heap would save nothing
+	 */
+	if (block->flags & (BLOCK_FLAG_BUDDY | BLOCK_FLAG_SPAN | BLOCK_FLAG_LONG))
+		return;
+
+	/* Like glibc does, a freed mapped block means that blocks of it's size
+	 * are not long lived, and they should be served by the heap from now on
+	 */
+	if (raw_size <= mmap_threshold || raw_size > mmap_threshold_max)
+		return;
 
-	return munmap((void *)block, length);
+	mmap_threshold = raw_size;
+	mem_stats.mmap_threshold_updates++;
 }
 
 block_meta_t *realloc_mapped_block(block_meta_t *block, size_t size)
@@ -464,23 +1166,34 @@ block_meta_t *realloc_mapped_block(block_meta_t *block, size_t size)
 	size_t raw_size = BLOCK_ALIGN + ALIGN(size);
 	block_meta_t *new_block;
 
-	if (raw_size <= MMAP_THRESHOLD && prealloc_done == NOT_DONE) {
+	if (span_fits(raw_size)) {
+		new_block = alloc_span_block(size);
+		if (new_block) {
+			add_block(new_block);
+			return new_block;
+		}
+	}
+
+	if (raw_size <= mmap_threshold && raw_size <= heap_prealloc_size &&
+	    prealloc_done == NOT_DONE) {
 		new_block = prealloc_heap();
 		if (!new_block)
 			return NULL;
 
 		add_block(new_block);
-		if (raw_size < MMAP_THRESHOLD && MMAP_THRESHOLD - raw_size >= MIN_SPACE)
+		if (raw_size < heap_prealloc_size &&
+		    heap_prealloc_size - raw_size >= split_threshold)
 			split_block(new_block, size);
 		else
 			new_block->status = STATUS_ALLOC;
+		metadir_update(new_block);
 
 		prealloc_done = DONE;
 		return new_block;
 	}
 
 	/* Search for unused blocks */
-	if (raw_size <= MMAP_THRESHOLD) {
+	if (raw_size <= mmap_threshold) {
 		block_meta_t *unused = reuse_block(size);
 
 		if (unused)
@@ -488,7 +1201,7 @@ block_meta_t *realloc_mapped_block(block_meta_t *block, size_t size)
 	}
 
 	/* Get a new block with the size adjusted */
-	new_block = alloc_new_block(size, MMAP_THRESHOLD);
+	new_block = alloc_new_block(size, mmap_threshold);
 	if (!new_block)
 		return NULL;
 
@@ -500,14 +1213,14 @@ block_meta_t *realloc_mapped_block(block_meta_t *block, size_t size)
 block_meta_t *move_to_mmap_space(block_meta_t *block, size_t size)
 {
 	/* First, some measures of safety */
-	if (ALIGN(size) + BLOCK_ALIGN <= MMAP_THRESHOLD)
+	if (ALIGN(size) + BLOCK_ALIGN <= mmap_threshold)
 		return NULL;
 
 	if (block->status != STATUS_ALLOC)
 		return NULL;
 
 	/* Get a new block and copy the contents */
-	block_meta_t *new_block = alloc_new_block(size, MMAP_THRESHOLD);
+	block_meta_t *new_block = alloc_new_block(size, mmap_threshold);
 
 	if (!new_block)
 		return NULL;
@@ -537,13 +1250,158 @@ block_meta_t *unite_blocks(block_meta_t *block, size_t size)
 	return NULL;
 }
 
+block_meta_t *unite_with_prev(block_meta_t *block, size_t size, size_t used)
+{
+	block_meta_t *prev = block->prev;
+
+	if (!prev || prev->status != STATUS_FREE)
+		return NULL;
+
+	size_t capacity = get_raw_size(prev) + BLOCK_ALIGN + get_raw_size(block);
+
+	if (capacity < ALIGN(size))
+		return NULL;
+
+	unsigned int flags = block->flags;
+
+	/* The headers are linked first, the payload overwrites the old header */
+	block->size = get_raw_size(block);
+	prev->size = get_raw_size(prev);
+	merge_with_prev(block);
+	memmove(get_address_by_block(prev), get_address_by_block(block), used);
+
+	prev->status = STATUS_ALLOC;
+	prev->flags = flags;
+	metadir_update(prev);
+
+	/* The predecessor may be much bigger than needed */
+	if (capacity - ALIGN(size) >= split_threshold)
+		split_block(prev, size);
+	else
+		prev->size = size;
+
+	return prev;
+}
+
+size_t growth_capacity(size_t size)
+{
+	size_t capacity = size + (size >> REALLOC_HEADROOM_SHIFT);
+
+	/* The headroom never pushes a heap block over the mmap threshold */
+	if (BLOCK_ALIGN + ALIGN(size) <= mmap_threshold &&
+	    BLOCK_ALIGN + ALIGN(capacity) > mmap_threshold)
+		capacity = mmap_threshold - BLOCK_ALIGN;
+
+	headroom_bytes += ALIGN(capacity) - ALIGN(size);
+	mem_stats.realloc_headroom_bytes += ALIGN(capacity) - ALIGN(size);
+
+	return capacity;
+}
+
+void reclaim_headroom(void)
+{
+	for (block_meta_t *iter = get_heap_start(); iter; iter = iter->next) {
+		if (iter->status != STATUS_ALLOC || !(iter->flags & BLOCK_FLAG_GROWING))
+			continue;
+
+		size_t size = iter->size;
+		size_t true_size = get_raw_size(iter);
+
+		if (true_size - ALIGN(size) < split_threshold)
+			continue;
+
+		iter->size = true_size;
+		merge_with_next(split_block(iter, size));
+	}
+
+	headroom_bytes = 0;
+	mem_stats.headroom_reclaims++;
+}
+
+block_meta_t *remap_block(block_meta_t *block, size_t size)
+{
+	/* Buddy blocks can only change size within their order */
+	if (block->flags & BLOCK_FLAG_BUDDY) {
+		if (buddy_resize(block, BLOCK_ALIGN + ALIGN(block->size), BLOCK_ALIGN + ALIGN(size)))
+			return NULL;
+
+		block->size = size;
+		return block;
+	}
+
+	/* Spans neither, the pages around them belong to other spans */
+	if (block->flags & BLOCK_FLAG_SPAN) {
+		if (PAGE_ALIGN(BLOCK_ALIGN + ALIGN(size)) != get_mapped_length(block))
+			return NULL;
+
+		block->size = size;
+		return block;
+	}
+
+	/* Long lived blocks only within their capacity, they sit between others */
+	if (block->flags & BLOCK_FLAG_LONG) {
+		if (ALIGN(size) > long_capacity(block))
+			return NULL;
+
+		block->size = size;
+		return block;
+	}
+
+	int out_of_line = block->flags & BLOCK_FLAG_OUT_OF_LINE;
+	size_t old_length = get_mapped_length(block);
+	size_t offset = out_of_line ? 0 : color_offset(block);
+	size_t new_length;
+
+	/* A coloured block keeps it's offset in the new mapping */
+	if (out_of_line)
+		new_length = PAGE_ALIGN(size);
+	else
+		new_length = offset + BLOCK_ALIGN + ALIGN(size);
+
+	/* The registry has to follow a moved mapping, and it reads the header */
+	void *start = get_mapping_start(block);
+
+	mapped_remove(block);
+
+	void *p = mremap(start, old_length, new_length, MREMAP_MAYMOVE);
+
+	if (p == MAP_FAILED) {
+		mapped_insert(block);
+		return NULL;
+	}
+
+	stats_remapped(old_length, new_length);
+
+	block_meta_t *new_block = block;
+
+	if (out_of_line)
+		block->prev = p;
+	else
+		new_block = (block_meta_t *)((char *)p + offset);
+
+	new_block->size = size;
+	mapped_insert(new_block);
+	return new_block;
+}
+
 void *get_address_by_block(block_meta_t *block)
 {
+	if (block->flags & BLOCK_FLAG_OUT_OF_LINE)
+		return block->prev;
+
 	return (void *)((char *)block + BLOCK_ALIGN);
 }
 
 block_meta_t *get_block_by_address(void *addr)
 {
+	/* Only page aligned payloads can have their header out of line */
+	if (page_aligned_maps && !((uintptr_t)addr & (PAGE_SIZE - 1))) {
+		block_meta_t *block = mapped_find(addr);
+
+		if (block)
+			return block;
+	}
+
 	return (block_meta_t *)((char *)addr - BLOCK_ALIGN);
 }
 
@@ -565,7 +1423,7 @@ size_t get_raw_size(block_meta_t *block)
 
 	/* Get the end address of current useful memory chunk */
 	if (!block->next)
-		end = sbrk(0);
+		end = heap_end();
 	else
 		end = (void *)block->next;
 
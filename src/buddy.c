@@ -0,0 +1,289 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "buddy.h"
+#include "config.h"
+#include "decay.h"
+#include "stats.h"
+
+/* Unit map values: the order of the block starting at the unit, relative to
+ * BUDDY_MIN_ORDER and plus one, with UNIT_FREE for the free blocks. Units
+ * inside a block are 0
+ */
+#define UNIT_FREE 0x80
+
+/* Free blocks are linked by a structure at their start. The page it lives
+ * on is always committed, it isn't counted in dirty
+ */
+struct buddy_free_block {
+	struct buddy_free_block *prev;
+	struct buddy_free_block *next;
+	struct buddy_free_block *lru_prev;	/* Dirty free blocks, the oldest first */
+	struct buddy_free_block *lru_next;
+	size_t dirty;				/* Pages that may be committed */
+	uint32_t epoch;				/* Decay epoch the block got dirty in */
+};
+
+struct buddy_region {
+	char *base;
+	uint8_t units[BUDDY_REGION_UNITS];
+};
+
+int buddy_enabled;
+
+static struct buddy_region regions[BUDDY_REGIONS];
+static size_t used_regions;
+static struct buddy_free_block *free_lists[BUDDY_ORDERS];
+static struct buddy_free_block *lru_head, *lru_tail;
+
+void buddy_init(void)
+{
+	buddy_enabled = env_size("OSMEM_BUDDY", 0) != 0;
+}
+
+static unsigned int order_of(size_t raw_size)
+{
+	unsigned int order = BUDDY_MIN_ORDER;
+
+	while ((1UL << order) < raw_size)
+		order++;
+
+	return order;
+}
+
+static struct buddy_region *region_of(void *p)
+{
+	for (size_t i = 0; i < used_regions; i++)
+		if ((char *)p >= regions[i].base && (char *)p < regions[i].base + BUDDY_REGION_SIZE)
+			return &regions[i];
+
+	return NULL;
+}
+
+static uint8_t *unit_of(struct buddy_region *region, void *p)
+{
+	return &region->units[((char *)p - region->base) >> BUDDY_MIN_ORDER];
+}
+
+/* Pages of a block that may be dirty, the one of the links left out */
+static size_t dirty_max(unsigned int order)
+{
+	return (1UL << order) / PAGE_SIZE - 1;
+}
+
+static void push_free(struct buddy_region *region, void *p, unsigned int order, size_t dirty)
+{
+	struct buddy_free_block *block = p;
+	struct buddy_free_block **list = &free_lists[order - BUDDY_MIN_ORDER];
+
+	block->prev = NULL;
+	block->next = *list;
+	if (*list)
+		(*list)->prev = block;
+	*list = block;
+
+	*unit_of(region, p) = (order - BUDDY_MIN_ORDER + 1) | UNIT_FREE;
+
+	block->dirty = dirty;
+	if (!dirty)
+		return;
+
+	/* A merged block takes the age of it's youngest part */
+	block->epoch = decay_epoch;
+	block->lru_prev = lru_tail;
+	block->lru_next = NULL;
+	if (lru_tail)
+		lru_tail->lru_next = block;
+	else
+		lru_head = block;
+	lru_tail = block;
+	decay_dirty_add(dirty);
+}
+
+static void unlink_free(struct buddy_region *region, void *p, unsigned int order)
+{
+	struct buddy_free_block *block = p;
+
+	if (block->prev)
+		block->prev->next = block->next;
+	else
+		free_lists[order - BUDDY_MIN_ORDER] = block->next;
+	if (block->next)
+		block->next->prev = block->prev;
+
+	if (block->dirty) {
+		if (block->lru_prev)
+			block->lru_prev->lru_next = block->lru_next;
+		else
+			lru_head = block->lru_next;
+		if (block->lru_next)
+			block->lru_next->lru_prev = block->lru_prev;
+		else
+			lru_tail = block->lru_prev;
+		decay_dirty_sub(block->dirty);
+	}
+
+	*unit_of(region, p) = 0;
+}
+
+/* Put a block in the free lists, merged with it's free buddies */
+static void insert_free(struct buddy_region *region, char *p, unsigned int order, size_t dirty)
+{
+	while (order < BUDDY_MAX_ORDER) {
+		size_t offset = (p - region->base) ^ (1UL << order);
+		char *buddy = region->base + offset;
+
+		if (*unit_of(region, buddy) != ((order - BUDDY_MIN_ORDER + 1) | UNIT_FREE))
+			break;
+
+		/* The links page of the upper half is inside the block now */
+		dirty += ((struct buddy_free_block *)buddy)->dirty + 1;
+		unlink_free(region, buddy, order);
+		if (buddy < p)
+			p = buddy;
+		order++;
+	}
+
+	if (dirty > dirty_max(order))
+		dirty = dirty_max(order);
+
+	/* Smaller free blocks keep their pages, they are likely reused soon. With
+	 * decay, the purger gives them back once they have aged
+	 */
+	if (!decay_enabled && order == BUDDY_MAX_ORDER) {
+		madvise(p, 1UL << order, MADV_DONTNEED);
+		mem_stats.buddy_purges++;
+		dirty = 0;
+	}
+
+	push_free(region, p, order, dirty);
+}
+
+static int add_region(void)
+{
+	if (used_regions == BUDDY_REGIONS)
+		return -1;
+
+	/* The pages are only accounted once they are touched */
+	void *p = mmap(NULL, BUDDY_REGION_SIZE, PROT_READ | PROT_WRITE,
+		       MAP_ANON | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+
+	if (p == MAP_FAILED)
+		return -1;
+
+	struct buddy_region *region = &regions[used_regions++];
+
+	region->base = p;
+	push_free(region, region->base, BUDDY_MAX_ORDER, 0);
+	push_free(region, region->base + (1UL << BUDDY_MAX_ORDER), BUDDY_MAX_ORDER, 0);
+
+	mem_stats.buddy_regions++;
+	mem_stats.buddy_reserved_bytes += BUDDY_REGION_SIZE;
+	return 0;
+}
+
+void *buddy_alloc(size_t raw_size)
+{
+	unsigned int order = order_of(raw_size);
+	unsigned int found = order;
+
+	while (found <= BUDDY_MAX_ORDER && !free_lists[found - BUDDY_MIN_ORDER])
+		found++;
+
+	if (found > BUDDY_MAX_ORDER) {
+		if (add_region())
+			return NULL;
+		found = BUDDY_MAX_ORDER;
+	}
+
+	char *p = (char *)free_lists[found - BUDDY_MIN_ORDER];
+	struct buddy_region *region = region_of(p);
+	size_t dirty = ((struct buddy_free_block *)p)->dirty;
+
+	unlink_free(region, p, found);
+
+	/* The upper halves of the split blocks stay free, as dirty as they can
+	 * be
+	 */
+	while (found > order) {
+		found--;
+		push_free(region, p + (1UL << found), found,
+			  dirty < dirty_max(found) ? dirty : dirty_max(found));
+	}
+
+	*unit_of(region, p) = order - BUDDY_MIN_ORDER + 1;
+
+	mem_stats.buddy_allocs++;
+	mem_stats.buddy_block_bytes += 1UL << order;
+	mem_stats.buddy_requested_bytes += raw_size;
+
+	return p;
+}
+
+void buddy_free(void *p, size_t raw_size)
+{
+	struct buddy_region *region = region_of(p);
+	unsigned int order = *unit_of(region, p) + BUDDY_MIN_ORDER - 1;
+
+	mem_stats.buddy_block_bytes -= 1UL << order;
+	mem_stats.buddy_requested_bytes -= raw_size;
+
+	*unit_of(region, p) = 0;
+
+	decay_freed(dirty_max(order));
+	insert_free(region, p, order, dirty_max(order));
+}
+
+int buddy_resize(void *p, size_t old_raw_size, size_t new_raw_size)
+{
+	struct buddy_region *region = region_of(p);
+	unsigned int order = *unit_of(region, p) + BUDDY_MIN_ORDER - 1;
+
+	if (new_raw_size > (1UL << order) ||
+	    (order > BUDDY_MIN_ORDER && new_raw_size <= (1UL << (order - 1))))
+		return -1;
+
+	mem_stats.buddy_requested_bytes += new_raw_size - old_raw_size;
+	return 0;
+}
+
+size_t buddy_block_size(void *p)
+{
+	struct buddy_region *region = region_of(p);
+
+	return 1UL << (*unit_of(region, p) + BUDDY_MIN_ORDER - 1);
+}
+
+int buddy_oldest_dirty(uint32_t *epoch)
+{
+	if (!lru_head)
+		return 0;
+
+	*epoch = lru_head->epoch;
+	return 1;
+}
+
+void buddy_take_dirty(purge_extent_t *ext)
+{
+	char *p = (char *)lru_head;
+	struct buddy_region *region = region_of(p);
+	unsigned int order = (*unit_of(region, p) & ~UNIT_FREE) + BUDDY_MIN_ORDER - 1;
+
+	/* It looks allocated to it's buddy until it comes back */
+	unlink_free(region, p, order);
+	*unit_of(region, p) = order - BUDDY_MIN_ORDER + 1;
+
+	ext->addr = p + PAGE_SIZE;
+	ext->len = (1UL << order) - PAGE_SIZE;
+	ext->source = DECAY_SOURCE_BUDDY;
+	ext->cookie = p;
+	ext->run = order;
+}
+
+void buddy_put_clean(purge_extent_t *ext)
+{
+	mem_stats.buddy_purges++;
+	insert_free(region_of(ext->cookie), ext->cookie, ext->run, 0);
+}
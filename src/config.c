@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+#include <string.h>
+#include "block_meta.h"
+#include "config.h"
+#include "segment.h"
+
+size_t mmap_threshold = MMAP_THRESHOLD;
+size_t mmap_threshold_max = MMAP_THRESHOLD;
+
+int heap_adaptive;
+size_t heap_prealloc_size = HEAP_PREALLOCATION_SIZE;
+size_t heap_growth_min;
+size_t heap_growth_max;
+size_t heap_reserve;
+int page_aligned_maps;
+int cache_color;
+
+int defer_coalesce;
+size_t quick_max_bytes = QUICK_MAX_BYTES_DEFAULT;
+
+int placement_policy = PLACEMENT_DEFAULT;
+size_t good_fit_percent = GOOD_FIT_PERCENT_DEFAULT;
+size_t split_threshold = SPLIT_THRESHOLD_DEFAULT;
+
+static const char * const placement_names[] = {
+	[PLACEMENT_BEST] = "best",
+	[PLACEMENT_FIRST] = "first",
+	[PLACEMENT_NEXT] = "next",
+	[PLACEMENT_GOOD] = "good",
+};
+
+size_t env_size(const char *name, size_t def)
+{
+	const char *env = getenv(name);
+	char *end;
+
+	if (!env || !*env)
+		return def;
+
+	unsigned long long value = strtoull(env, &end, 0);
+
+	switch (*end) {
+	case 'g':
+	case 'G':
+		value <<= 10;
+		/* fallthrough */
+	case 'm':
+	case 'M':
+		value <<= 10;
+		/* fallthrough */
+	case 'k':
+	case 'K':
+		value <<= 10;
+		end++;
+		break;
+	default:
+		break;
+	}
+
+	if (*end)
+		return def;
+
+	return (size_t)value;
+}
+
+void config_init(void)
+{
+	mmap_threshold = env_size("OSMEM_MMAP_THRESHOLD", MMAP_THRESHOLD);
+
+	/* The threshold is dynamic only when it is allowed to grow */
+	mmap_threshold_max = env_size("OSMEM_MMAP_THRESHOLD_MAX", mmap_threshold);
+	if (mmap_threshold_max > MMAP_THRESHOLD_CAP)
+		mmap_threshold_max = MMAP_THRESHOLD_CAP;
+	if (mmap_threshold_max < mmap_threshold)
+		mmap_threshold_max = mmap_threshold;
+
+	const char *env = getenv("OSMEM_PLACEMENT");
+
+	for (size_t i = 0; env && i < sizeof(placement_names) / sizeof(*placement_names); i++)
+		if (!strcmp(env, placement_names[i]))
+			placement_policy = i;
+
+	good_fit_percent = env_size("OSMEM_GOOD_FIT_PERCENT", GOOD_FIT_PERCENT_DEFAULT);
+	split_threshold = env_size("OSMEM_SPLIT_THRESHOLD", SPLIT_THRESHOLD_DEFAULT);
+	if (split_threshold < MIN_SPACE)
+		split_threshold = MIN_SPACE;
+
+	defer_coalesce = env_size("OSMEM_DEFER_COALESCE", 0) != 0;
+	quick_max_bytes = env_size("OSMEM_QUICK_MAX_BYTES", QUICK_MAX_BYTES_DEFAULT);
+
+	heap_reserve = env_size("OSMEM_HEAP_RESERVE", 0);
+	if (heap_reserve == 1)
+		heap_reserve = HEAP_RESERVE_DEFAULT;
+
+	page_aligned_maps = env_size("OSMEM_PAGE_ALIGNED_MAPS", 0) != 0;
+	cache_color = env_size("OSMEM_CACHE_COLOR", 0) != 0;
+
+	heap_growth_min = env_size("OSMEM_HEAP_PREALLOC_MIN", 0);
+	heap_growth_max = env_size("OSMEM_HEAP_PREALLOC_MAX", 0);
+	heap_adaptive = heap_growth_min || heap_growth_max;
+	if (!heap_adaptive)
+		return;
+
+	/* Steps are whole pages, and the ceiling is never under the floor */
+	if (!heap_growth_min)
+		heap_growth_min = HEAP_GROWTH_MIN_DEFAULT;
+	if (!heap_growth_max)
+		heap_growth_max = HEAP_GROWTH_MAX_DEFAULT;
+	heap_growth_min = (heap_growth_min + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1);
+	if (heap_growth_max < heap_growth_min)
+		heap_growth_max = heap_growth_min;
+
+	heap_prealloc_size = heap_growth_min;
+}
@@ -0,0 +1,205 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include "blck.h"
+#include "buddy.h"
+#include "config.h"
+#include "decay.h"
+#include "span.h"
+#include "stats.h"
+
+int decay_enabled;
+pthread_mutex_t decay_mutex = PTHREAD_MUTEX_INITIALIZER;
+uint32_t decay_epoch;
+
+static uint64_t epoch_ns;
+static int decay_curve = DECAY_SMOOTHSTEP;
+static int purge_advice = MADV_DONTNEED;
+
+/* Pages freed in each of the last DECAY_EPOCHS epochs, by epoch number */
+static size_t backlog[DECAY_EPOCHS];
+static uint64_t epoch_start;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void decay_freed(size_t pages)
+{
+	backlog[decay_epoch % DECAY_EPOCHS] += pages;
+}
+
+void decay_dirty_add(size_t pages)
+{
+	mem_stats.dirty_bytes += pages * PAGE_SIZE;
+}
+
+void decay_dirty_sub(size_t pages)
+{
+	mem_stats.dirty_bytes -= pages * PAGE_SIZE;
+}
+
+/* Start the epochs that began since the last call, forgetting the pages
+ * freed in the ones that fall out of the window
+ */
+static void advance(uint64_t now)
+{
+	uint64_t passed = (now - epoch_start) / epoch_ns;
+
+	epoch_start += passed * epoch_ns;
+	for (uint64_t i = 0; i < passed && i < DECAY_EPOCHS; i++)
+		backlog[(decay_epoch + 1 + i) % DECAY_EPOCHS] = 0;
+	decay_epoch += passed;
+}
+
+/* Fraction of the pages freed age epochs ago that may still be dirty */
+static double curve(uint32_t age)
+{
+	double t = (double)age / DECAY_EPOCHS;
+
+	if (decay_curve == DECAY_LINEAR)
+		return 1.0 - t;
+
+	return 1.0 - t * t * (3.0 - 2.0 * t);
+}
+
+/* Dirty pages allowed to stay, in bytes */
+static size_t dirty_limit(void)
+{
+	double pages = 0;
+
+	for (uint32_t age = 0; age < DECAY_EPOCHS; age++)
+		pages += backlog[(decay_epoch - age) % DECAY_EPOCHS] * curve(age);
+
+	return (size_t)pages * PAGE_SIZE;
+}
+
+/* Take the oldest dirty run of the three sources out, 0 if there is none */
+static int take_oldest(purge_extent_t *ext, block_meta_t *heap_block, uint32_t heap_epoch)
+{
+	uint32_t epoch, span_epoch, buddy_epoch;
+	int span = span_oldest_dirty(&span_epoch);
+	int buddy = buddy_oldest_dirty(&buddy_epoch);
+	int source = -1;
+
+	if (span) {
+		source = DECAY_SOURCE_SPAN;
+		epoch = span_epoch;
+	}
+	if (buddy && (source < 0 || (int32_t)(buddy_epoch - epoch) < 0)) {
+		source = DECAY_SOURCE_BUDDY;
+		epoch = buddy_epoch;
+	}
+	if (heap_block && (source < 0 || (int32_t)(heap_epoch - epoch) < 0))
+		source = DECAY_SOURCE_HEAP;
+
+	if (source == DECAY_SOURCE_SPAN)
+		span_take_dirty(ext);
+	else if (source == DECAY_SOURCE_BUDDY)
+		buddy_take_dirty(ext);
+	else if (source == DECAY_SOURCE_HEAP)
+		heap_take_dirty(heap_block, ext);
+
+	return source >= 0;
+}
+
+static void put_clean(purge_extent_t *ext)
+{
+	if (ext->source == DECAY_SOURCE_SPAN)
+		span_put_clean(ext);
+	else if (ext->source == DECAY_SOURCE_BUDDY)
+		buddy_put_clean(ext);
+	else
+		heap_put_clean(ext);
+}
+
+/* Purge the oldest runs until the dirty pages are back under the curve */
+static void purge(void)
+{
+	purge_extent_t ext;
+	int purged = 0;
+
+	pthread_mutex_lock(&decay_mutex);
+	advance(now_ns());
+
+	size_t limit = dirty_limit();
+
+	for (;;) {
+		uint32_t heap_epoch = 0;
+		block_meta_t *heap_block = heap_oldest_dirty(&heap_epoch);
+
+		if (mem_stats.dirty_bytes + mem_stats.heap_dirty_bytes <= limit ||
+		    !take_oldest(&ext, heap_block, heap_epoch))
+			break;
+
+		pthread_mutex_unlock(&decay_mutex);
+		madvise(ext.addr, ext.len, purge_advice);
+		pthread_mutex_lock(&decay_mutex);
+
+		put_clean(&ext);
+		mem_stats.purge_calls++;
+		mem_stats.purged_bytes += ext.len;
+		purged = 1;
+	}
+
+	mem_stats.purge_passes += purged;
+	pthread_mutex_unlock(&decay_mutex);
+}
+
+static void *purger(void *arg)
+{
+	struct timespec ts = {
+		.tv_sec = epoch_ns / 1000000000ULL,
+		.tv_nsec = epoch_ns % 1000000000ULL,
+	};
+
+	(void)arg;
+	for (;;) {
+		nanosleep(&ts, NULL);
+		purge();
+	}
+
+	return NULL;
+}
+
+void decay_init(void)
+{
+	const char *env = getenv("OSMEM_DECAY_MS");
+
+	if (!env || !*env)
+		return;
+
+	epoch_ns = env_size("OSMEM_DECAY_MS", 0) * 1000000ULL / DECAY_EPOCHS;
+	if (epoch_ns < DECAY_EPOCH_MIN_NS)
+		epoch_ns = DECAY_EPOCH_MIN_NS;
+
+	env = getenv("OSMEM_DECAY_CURVE");
+	if (env && !strcmp(env, "linear"))
+		decay_curve = DECAY_LINEAR;
+
+	env = getenv("OSMEM_PURGE");
+	if (env && !strcmp(env, "free"))
+		purge_advice = MADV_FREE;
+
+	epoch_start = now_ns();
+
+	/* The purger takes no signals, they belong to the program's threads */
+	sigset_t all, old;
+	pthread_t thread;
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	if (!pthread_create(&thread, NULL, purger, NULL)) {
+		pthread_detach(thread);
+		decay_enabled = 1;
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
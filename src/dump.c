@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "blck.h"
+#include "dump.h"
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+	while (len) {
+		ssize_t ret = write(fd, buf, len);
+
+		if (ret < 0)
+			return -1;
+
+		buf += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+static const char *status_name(int status)
+{
+	switch (status) {
+	case STATUS_FREE:
+		return "free";
+	case STATUS_ALLOC:
+		return "alloc";
+	case STATUS_MAPPED:
+		return "mapped";
+	case STATUS_QUICK:
+		return "quick";
+	default:
+		return "unknown";
+	}
+}
+
+int heap_dump(int fd)
+{
+	char line[128];
+	int len;
+
+	/* Mapped blocks are not in the Memory List, it holds only the heap */
+	block_meta_t *heap_start = head;
+
+	len = snprintf(line, sizeof(line), "osmem-heap-dump %d\nlayout %lu %lu\nheap 0x%lx 0x%lx\n",
+		       HEAP_DUMP_VERSION, (unsigned long)BLOCK_ALIGN, (unsigned long)ALIGNMENT,
+		       (unsigned long)heap_start, heap_start ? (unsigned long)heap_end() : 0UL);
+	if (write_all(fd, line, len))
+		return -1;
+
+	size_t cursor = 0;
+
+	for (block_meta_t *iter = mapped_next(&cursor); iter; iter = mapped_next(&cursor)) {
+		/* The payload capacity is the rest of the mapping */
+		char *start = get_mapping_start(iter);
+		size_t capacity = start + get_mapped_length(iter) - (char *)get_address_by_block(iter);
+
+		len = snprintf(line, sizeof(line), "block mmap 0x%lx %lu %lu %s\n",
+			       (unsigned long)start, iter->size, capacity, status_name(iter->status));
+
+		if (write_all(fd, line, len))
+			return -1;
+	}
+
+	for (block_meta_t *iter = long_next(NULL); iter; iter = long_next(iter)) {
+		int free = iter->status == STATUS_FREE;
+
+		len = snprintf(line, sizeof(line), "block long 0x%lx %lu %lu %s\n", (unsigned long)iter,
+			       free ? long_capacity(iter) : iter->size, long_capacity(iter),
+			       free ? "free" : "alloc");
+
+		if (write_all(fd, line, len))
+			return -1;
+	}
+
+	for (block_meta_t *iter = head; iter; iter = iter->next) {
+		len = snprintf(line, sizeof(line), "block heap %lu %lu %lu %s\n",
+			       (unsigned long)((char *)iter - (char *)heap_start),
+			       iter->status == STATUS_QUICK ? get_raw_size(iter) : iter->size,
+			       get_raw_size(iter), status_name(iter->status));
+
+		if (write_all(fd, line, len))
+			return -1;
+	}
+
+	return 0;
+}
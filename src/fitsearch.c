@@ -0,0 +1,195 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+#include <string.h>
+#include "fitsearch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FIT_SEARCH_X86
+#endif
+
+fit_search_fn fit_search = fit_search_scalar;
+
+static const char * const kernel_names[] = {
+	[FIT_SEARCH_SCALAR] = "scalar",
+	[FIT_SEARCH_SSE41] = "sse4.1",
+	[FIT_SEARCH_AVX2] = "avx2",
+};
+
+/* Continues a search from index i, with the best entry found so far */
+static size_t search_tail(const uint32_t *sizes, size_t i, size_t n, uint32_t need,
+			  uint32_t good, size_t best)
+{
+	for (; i < n; i++) {
+		uint32_t v = sizes[i];
+
+		if (v < need)
+			continue;
+
+		if (v <= good)
+			return i;
+
+		if (best == n || v < sizes[best])
+			best = i;
+	}
+
+	return best;
+}
+
+size_t fit_search_scalar(const uint32_t *sizes, size_t n, uint32_t need, uint32_t good)
+{
+	return search_tail(sizes, 0, n, need, good, n);
+}
+
+#ifdef FIT_SEARCH_X86
+
+/* Picks the lane with the smallest size, the lowest index on ties */
+static size_t reduce_lanes(const uint32_t *mins, const uint32_t *idxs, int lanes, size_t n)
+{
+	size_t best = n;
+	uint32_t best_size = UINT32_MAX;
+
+	for (int l = 0; l < lanes; l++) {
+		if (mins[l] == UINT32_MAX)
+			continue;
+
+		if (mins[l] < best_size || (mins[l] == best_size && idxs[l] < best)) {
+			best_size = mins[l];
+			best = idxs[l];
+		}
+	}
+
+	return best;
+}
+
+/* Every lane keeps the first position of it's smallest fitting size; the
+ * sizes that don't fit are turned into UINT32_MAX. The comparisons are
+ * unsigned, done with min/max and equality
+ */
+__attribute__((target("sse4.1")))
+size_t fit_search_sse41(const uint32_t *sizes, size_t n, uint32_t need, uint32_t good)
+{
+	const __m128i ones = _mm_set1_epi32(-1);
+	const __m128i vneed = _mm_set1_epi32(need);
+	const __m128i vgood = _mm_set1_epi32(good);
+	const __m128i step = _mm_set1_epi32(4);
+	__m128i vmin = ones;
+	__m128i vidx = _mm_setzero_si128();
+	__m128i vpos = _mm_setr_epi32(0, 1, 2, 3);
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(sizes + i));
+		__m128i fits = _mm_cmpeq_epi32(_mm_max_epu32(v, vneed), v);
+		__m128i good_fit = _mm_and_si128(fits, _mm_cmpeq_epi32(_mm_min_epu32(v, vgood), v));
+		int mask = _mm_movemask_ps(_mm_castsi128_ps(good_fit));
+
+		if (mask)
+			return i + __builtin_ctz(mask);
+
+		__m128i w = _mm_or_si128(v, _mm_xor_si128(fits, ones));
+		__m128i lower = _mm_xor_si128(_mm_cmpeq_epi32(_mm_min_epu32(w, vmin), vmin), ones);
+
+		vmin = _mm_min_epu32(w, vmin);
+		vidx = _mm_blendv_epi8(vidx, vpos, lower);
+		vpos = _mm_add_epi32(vpos, step);
+	}
+
+	uint32_t mins[4], idxs[4];
+
+	_mm_storeu_si128((__m128i *)mins, vmin);
+	_mm_storeu_si128((__m128i *)idxs, vidx);
+
+	return search_tail(sizes, i, n, need, good, reduce_lanes(mins, idxs, 4, n));
+}
+
+__attribute__((target("avx2")))
+size_t fit_search_avx2(const uint32_t *sizes, size_t n, uint32_t need, uint32_t good)
+{
+	const __m256i ones = _mm256_set1_epi32(-1);
+	const __m256i vneed = _mm256_set1_epi32(need);
+	const __m256i vgood = _mm256_set1_epi32(good);
+	const __m256i step = _mm256_set1_epi32(8);
+	__m256i vmin = ones;
+	__m256i vidx = _mm256_setzero_si256();
+	__m256i vpos = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(sizes + i));
+		__m256i fits = _mm256_cmpeq_epi32(_mm256_max_epu32(v, vneed), v);
+		__m256i good_fit = _mm256_and_si256(fits,
+						    _mm256_cmpeq_epi32(_mm256_min_epu32(v, vgood), v));
+		int mask = _mm256_movemask_ps(_mm256_castsi256_ps(good_fit));
+
+		if (mask)
+			return i + __builtin_ctz(mask);
+
+		__m256i w = _mm256_or_si256(v, _mm256_xor_si256(fits, ones));
+		__m256i lower = _mm256_xor_si256(_mm256_cmpeq_epi32(_mm256_min_epu32(w, vmin), vmin),
+						 ones);
+
+		vmin = _mm256_min_epu32(w, vmin);
+		vidx = _mm256_blendv_epi8(vidx, vpos, lower);
+		vpos = _mm256_add_epi32(vpos, step);
+	}
+
+	uint32_t mins[8], idxs[8];
+
+	_mm256_storeu_si256((__m256i *)mins, vmin);
+	_mm256_storeu_si256((__m256i *)idxs, vidx);
+
+	return search_tail(sizes, i, n, need, good, reduce_lanes(mins, idxs, 8, n));
+}
+
+fit_search_fn fit_search_kernel(int kind)
+{
+	__builtin_cpu_init();
+
+	switch (kind) {
+	case FIT_SEARCH_AVX2:
+		return __builtin_cpu_supports("avx2") ? fit_search_avx2 : NULL;
+	case FIT_SEARCH_SSE41:
+		return __builtin_cpu_supports("sse4.1") ? fit_search_sse41 : NULL;
+	case FIT_SEARCH_SCALAR:
+		return fit_search_scalar;
+	default:
+		return NULL;
+	}
+}
+
+#else
+
+size_t fit_search_sse41(const uint32_t *sizes, size_t n, uint32_t need, uint32_t good)
+{
+	return fit_search_scalar(sizes, n, need, good);
+}
+
+size_t fit_search_avx2(const uint32_t *sizes, size_t n, uint32_t need, uint32_t good)
+{
+	return fit_search_scalar(sizes, n, need, good);
+}
+
+fit_search_fn fit_search_kernel(int kind)
+{
+	return kind == FIT_SEARCH_SCALAR ? fit_search_scalar : NULL;
+}
+
+#endif
+
+int fit_search_init(void)
+{
+	const char *env = getenv("OSMEM_FIT_SEARCH");
+	int kind = FIT_SEARCH_AVX2;
+
+	for (int i = 0; env && i <= FIT_SEARCH_AVX2; i++)
+		if (!strcmp(env, kernel_names[i]))
+			kind = i;
+
+	while (!fit_search_kernel(kind))
+		kind--;
+
+	fit_search = fit_search_kernel(kind);
+	return kind;
+}
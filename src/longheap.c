@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <sys/mman.h>
+#include "longheap.h"
+#include "segment.h"
+#include "stats.h"
+
+/* The blocks are kept in address order, linked by their prev and next
+ * fields like the Memory List. Free ones have STATUS_FREE, the others
+ * STATUS_MAPPED, and no two free blocks are next to each other
+ */
+static heap_segment_t *long_segment;
+static block_meta_t *long_head, *long_tail;
+static size_t long_blocks;
+
+size_t long_capacity(block_meta_t *block)
+{
+	char *end = block->next ? (char *)block->next : long_segment->brk;
+
+	return end - (char *)block - BLOCK_ALIGN;
+}
+
+block_meta_t *long_next(block_meta_t *block)
+{
+	return block ? block->next : long_head;
+}
+
+/* Make room for size bytes at the top of the segment. The free tail is
+ * extended, otherwise a new free block is added after it
+ */
+static block_meta_t *grow(size_t size)
+{
+	if (!long_segment)
+		long_segment = segment_create(LONG_HEAP_RESERVE);
+	if (!long_segment)
+		return NULL;
+
+	int extend = long_tail && long_tail->status == STATUS_FREE;
+	size_t missing = extend ? ALIGN(size) - long_capacity(long_tail) : BLOCK_ALIGN + ALIGN(size);
+	size_t increment = (missing + LONG_GROW_SIZE - 1) & ~(size_t)(LONG_GROW_SIZE - 1);
+	void *p = segment_sbrk(long_segment, increment);
+
+	if (p == MAP_FAILED)
+		return NULL;
+
+	mem_stats.long_heap_bytes += increment;
+	if (extend)
+		return long_tail;
+
+	block_meta_t *block = p;
+
+	block->status = STATUS_FREE;
+	block->flags = BLOCK_FLAG_LONG;
+	block->prev = long_tail;
+	block->next = NULL;
+
+	if (long_tail)
+		long_tail->next = block;
+	else
+		long_head = block;
+	long_tail = block;
+
+	return block;
+}
+
+block_meta_t *long_alloc(size_t size)
+{
+	block_meta_t *block = NULL;
+
+	/* First fit, the blocks are packed at the bottom */
+	for (block_meta_t *iter = long_head; iter && !block; iter = iter->next)
+		if (iter->status == STATUS_FREE && long_capacity(iter) >= ALIGN(size))
+			block = iter;
+
+	if (!block)
+		block = grow(size);
+	if (!block) {
+		/* A segment that was just created holds nothing */
+		if (long_segment && !long_head) {
+			segment_destroy(long_segment);
+			long_segment = NULL;
+		}
+		return NULL;
+	}
+
+	/* The rest of the block becomes a free block of it's own */
+	if (long_capacity(block) - ALIGN(size) >= MIN_SPACE) {
+		block_meta_t *rest = (block_meta_t *)((char *)block + BLOCK_ALIGN + ALIGN(size));
+
+		rest->status = STATUS_FREE;
+		rest->flags = BLOCK_FLAG_LONG;
+		rest->prev = block;
+		rest->next = block->next;
+
+		if (block->next)
+			block->next->prev = rest;
+		else
+			long_tail = rest;
+		block->next = rest;
+	}
+
+	block->size = size;
+	block->status = STATUS_MAPPED;
+	block->flags = BLOCK_FLAG_LONG;
+
+	long_blocks++;
+	mem_stats.long_live_bytes += BLOCK_ALIGN + long_capacity(block);
+	return block;
+}
+
+/* Merge a free block with the free block after it */
+static void merge_next(block_meta_t *block)
+{
+	block_meta_t *next = block->next;
+
+	if (!next || next->status != STATUS_FREE)
+		return;
+
+	block->next = next->next;
+	if (next->next)
+		next->next->prev = block;
+	else
+		long_tail = block;
+}
+
+void long_free(block_meta_t *block)
+{
+	mem_stats.long_live_bytes -= BLOCK_ALIGN + long_capacity(block);
+	block->status = STATUS_FREE;
+	block->flags = BLOCK_FLAG_LONG;
+
+	merge_next(block);
+	if (block->prev && block->prev->status == STATUS_FREE)
+		merge_next(block->prev);
+
+	/* Without long lived blocks left, the whole segment goes back */
+	if (--long_blocks)
+		return;
+
+	mem_stats.long_heap_bytes = 0;
+	segment_destroy(long_segment);
+	long_segment = NULL;
+	long_head = NULL;
+	long_tail = NULL;
+}
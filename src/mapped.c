@@ -0,0 +1,150 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "mapped.h"
+
+static block_meta_t *initial_slots[MAPPED_INITIAL_SLOTS];
+static block_meta_t **slots = initial_slots;
+static size_t slots_mask = MAPPED_INITIAL_SLOTS - 1;
+static size_t used;
+
+/* Free out of line headers, linked by their next field */
+static block_meta_t *free_headers;
+
+/* Blocks are keyed by the start of their mapping */
+static void *key_of(block_meta_t *block)
+{
+	if (block->flags & BLOCK_FLAG_OUT_OF_LINE)
+		return (void *)block->prev;
+
+	return block;
+}
+
+static size_t slot_of(void *key)
+{
+	/* Mappings are page aligned, the low bits carry no information */
+	return (size_t)(((uintptr_t)key >> 12) * 0x9E3779B97F4A7C15ULL >> 20) & slots_mask;
+}
+
+static void place(block_meta_t *block)
+{
+	size_t i = slot_of(key_of(block));
+
+	while (slots[i])
+		i = (i + 1) & slots_mask;
+
+	slots[i] = block;
+}
+
+static void grow_table(void)
+{
+	block_meta_t **old = slots;
+	size_t old_slots = slots_mask + 1;
+	void *p = mmap(NULL, 2 * old_slots * sizeof(*slots), PROT_READ | PROT_WRITE,
+		       MAP_ANON | MAP_PRIVATE, -1, 0);
+
+	DIE(p == MAP_FAILED, "mapped: failed to grow the registry\n");
+	slots = p;
+	slots_mask = 2 * old_slots - 1;
+
+	for (size_t i = 0; i < old_slots; i++)
+		if (old[i])
+			place(old[i]);
+
+	if (old != initial_slots)
+		munmap(old, old_slots * sizeof(*old));
+}
+
+void mapped_insert(block_meta_t *block)
+{
+	if (used + 1 > (slots_mask + 1) / 4 * 3)
+		grow_table();
+
+	if (!(block->flags & BLOCK_FLAG_OUT_OF_LINE))
+		block->prev = NULL;
+	block->next = NULL;
+	place(block);
+	used++;
+}
+
+void mapped_remove(block_meta_t *block)
+{
+	size_t i = slot_of(key_of(block));
+
+	while (slots[i] != block) {
+		DIE(!slots[i], "mapped: unknown block\n");
+		i = (i + 1) & slots_mask;
+	}
+
+	/* Backward shift deletion, so that no tombstones are needed */
+	size_t j = i;
+
+	for (;;) {
+		slots[i] = NULL;
+		do {
+			j = (j + 1) & slots_mask;
+			if (!slots[j]) {
+				used--;
+				return;
+			}
+		} while (((j - slot_of(key_of(slots[j]))) & slots_mask) < ((j - i) & slots_mask));
+
+		slots[i] = slots[j];
+		i = j;
+	}
+}
+
+block_meta_t *mapped_find(void *addr)
+{
+	for (size_t i = slot_of(addr); slots[i]; i = (i + 1) & slots_mask)
+		if (key_of(slots[i]) == addr)
+			return slots[i];
+
+	return NULL;
+}
+
+block_meta_t *mapped_header_alloc(void)
+{
+	if (!free_headers) {
+		block_meta_t *chunk = mmap(NULL, MAPPED_HEADER_CHUNK, PROT_READ | PROT_WRITE,
+					   MAP_ANON | MAP_PRIVATE, -1, 0);
+
+		if (chunk == MAP_FAILED)
+			return NULL;
+
+		for (size_t i = 0; i < MAPPED_HEADER_CHUNK / sizeof(*chunk); i++) {
+			chunk[i].next = free_headers;
+			free_headers = &chunk[i];
+		}
+	}
+
+	block_meta_t *block = free_headers;
+
+	free_headers = block->next;
+	return block;
+}
+
+void mapped_header_free(block_meta_t *block)
+{
+	block->next = free_headers;
+	free_headers = block;
+}
+
+size_t mapped_count(void)
+{
+	return used;
+}
+
+block_meta_t *mapped_next(size_t *cursor)
+{
+	while (*cursor <= slots_mask) {
+		block_meta_t *block = slots[(*cursor)++];
+
+		if (block)
+			return block;
+	}
+
+	return NULL;
+}
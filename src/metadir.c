@@ -0,0 +1,208 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <sys/mman.h>
+#include "blck.h"
+#include "fitsearch.h"
+#include "metadir.h"
+
+int metadir_enabled;
+
+/* The offsets and the sizes are counted in ALIGNMENT units, from the first
+ * heap block, which never moves. The fit sizes are the sizes of the free
+ * blocks and 0 for the others, so that the searches read a single array
+ */
+static char *base;
+static uint32_t *offsets;
+static uint32_t *sizes;
+static uint32_t *fit_sizes;
+static uint8_t *statuses;
+static size_t count;
+static size_t entries;
+
+void metadir_init(void)
+{
+	metadir_enabled = env_size("OSMEM_META_DIRECTORY", 0) != 0;
+	if (metadir_enabled)
+		fit_search_init();
+}
+
+static void *resize_array(void *array, size_t old_len, size_t new_len)
+{
+	void *p;
+
+	if (!array)
+		p = mmap(NULL, new_len, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+	else
+		p = mremap(array, old_len, new_len, MREMAP_MAYMOVE);
+
+	DIE(p == MAP_FAILED, "metadir: failed to map the directory\n");
+	return p;
+}
+
+static void grow_directory(void)
+{
+	size_t new_entries = entries ? 2 * entries : METADIR_INITIAL_ENTRIES;
+
+	offsets = resize_array(offsets, entries * sizeof(*offsets), new_entries * sizeof(*offsets));
+	sizes = resize_array(sizes, entries * sizeof(*sizes), new_entries * sizeof(*sizes));
+	fit_sizes = resize_array(fit_sizes, entries * sizeof(*fit_sizes),
+				 new_entries * sizeof(*fit_sizes));
+	statuses = resize_array(statuses, entries * sizeof(*statuses),
+				new_entries * sizeof(*statuses));
+	entries = new_entries;
+}
+
+static uint32_t offset_of(block_meta_t *block)
+{
+	size_t off = ((char *)block - base) / ALIGNMENT;
+
+	DIE(off > UINT32_MAX, "metadir: the heap is too big for the directory\n");
+	return (uint32_t)off;
+}
+
+static block_meta_t *block_at(size_t i)
+{
+	return (block_meta_t *)(base + (size_t)offsets[i] * ALIGNMENT);
+}
+
+/* Index of the first entry whose offset isn't below off */
+static size_t lower_bound(uint32_t off)
+{
+	size_t lo = 0, hi = count;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+
+		if (offsets[mid] < off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static size_t index_of(block_meta_t *block)
+{
+	size_t i = lower_bound(offset_of(block));
+
+	DIE(i == count || block_at(i) != block, "metadir: unknown block\n");
+	return i;
+}
+
+/* The raw size of a block is the distance to the next one, or to the end of
+ * the heap for the last one
+ */
+static void refresh_size(size_t i)
+{
+	size_t end = i + 1 < count ? offsets[i + 1] : ((char *)heap_end() - base) / ALIGNMENT;
+
+	sizes[i] = (uint32_t)(end - offsets[i] - BLOCK_ALIGN / ALIGNMENT);
+	fit_sizes[i] = statuses[i] == STATUS_FREE ? sizes[i] : 0;
+}
+
+void metadir_insert_block(block_meta_t *block)
+{
+	if (!count)
+		base = (char *)block;
+	if (count == entries)
+		grow_directory();
+
+	uint32_t off = offset_of(block);
+	size_t i = lower_bound(off);
+	size_t tail = count - i;
+
+	memmove(&offsets[i + 1], &offsets[i], tail * sizeof(*offsets));
+	memmove(&sizes[i + 1], &sizes[i], tail * sizeof(*sizes));
+	memmove(&fit_sizes[i + 1], &fit_sizes[i], tail * sizeof(*fit_sizes));
+	memmove(&statuses[i + 1], &statuses[i], tail * sizeof(*statuses));
+	count++;
+
+	offsets[i] = off;
+	statuses[i] = block->status;
+	refresh_size(i);
+	if (i)
+		refresh_size(i - 1);
+}
+
+void metadir_remove_block(block_meta_t *block)
+{
+	size_t i = index_of(block);
+	size_t tail = count - i - 1;
+
+	memmove(&offsets[i], &offsets[i + 1], tail * sizeof(*offsets));
+	memmove(&sizes[i], &sizes[i + 1], tail * sizeof(*sizes));
+	memmove(&fit_sizes[i], &fit_sizes[i + 1], tail * sizeof(*fit_sizes));
+	memmove(&statuses[i], &statuses[i + 1], tail * sizeof(*statuses));
+	count--;
+
+	if (i)
+		refresh_size(i - 1);
+}
+
+void metadir_update_block(block_meta_t *block)
+{
+	size_t i = index_of(block);
+
+	statuses[i] = block->status;
+	fit_sizes[i] = statuses[i] == STATUS_FREE ? sizes[i] : 0;
+}
+
+void metadir_refresh_tail(void)
+{
+	if (count)
+		refresh_size(count - 1);
+}
+
+block_meta_t *metadir_first(void)
+{
+	return count ? block_at(0) : NULL;
+}
+
+block_meta_t *metadir_last(void)
+{
+	return count ? block_at(count - 1) : NULL;
+}
+
+/* Sizes in directory units; 0 never fits, it marks the blocks in use */
+static uint32_t need_units(size_t size)
+{
+	uint32_t need = ALIGN(size) / ALIGNMENT;
+
+	return need ? need : 1;
+}
+
+block_meta_t *metadir_find(size_t size, size_t good_size, int first)
+{
+	uint32_t need = need_units(size);
+	uint32_t good = first ? UINT32_MAX : good_size / ALIGNMENT;
+	size_t i = fit_search(fit_sizes, count, need, good);
+
+	return i == count ? NULL : block_at(i);
+}
+
+block_meta_t *metadir_find_from(size_t size, block_meta_t *start)
+{
+	uint32_t need = need_units(size);
+	size_t from = start ? index_of(start) : 0;
+	size_t i = fit_search(fit_sizes + from, count - from, need, UINT32_MAX);
+
+	if (i < count - from)
+		return block_at(from + i);
+
+	i = fit_search(fit_sizes, from, need, UINT32_MAX);
+	return i == from ? NULL : block_at(i);
+}
+
+block_meta_t *metadir_find_last(size_t size)
+{
+	uint32_t need = need_units(size);
+
+	for (size_t i = count; i-- > 0;)
+		if (fit_sizes[i] >= need)
+			return block_at(i);
+
+	return NULL;
+}
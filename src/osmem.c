@@ -1,10 +1,18 @@
 // SPDX-License-Identifier: BSD-3-Clause
 
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
 #include "osmem.h"
 
 /* Because of vmchecker I had to include these 2 here */
 #include "block_meta.h"
 #include "blck.h"
+#include "dump.h"
+#include "metadir.h"
+#include "prof.h"
+#include "site.h"
+#include "trace.h"
 
 /* Global head of the Memory List */
 block_meta_t *head;
@@ -12,61 +20,200 @@ block_meta_t *head;
 /* Global heap preallocation */
 int prealloc_done = NOT_DONE;
 
-void *os_malloc(size_t size)
+/* Global allocator statistics */
+os_mem_stats_t mem_stats;
+
+static void __attribute__((constructor)) os_init(void)
 {
-	/* If size is 0, return NULL and do nothing*/
-	if (size == 0)
-		return NULL;
+	config_init();
+	prof_init();
+	trace_init();
+	site_init();
+	metadir_init();
+	buddy_init();
+	span_init();
+	decay_init();
+	reclaim_init();
+}
+
+static void __attribute__((destructor)) os_fini(void)
+{
+	trace_flush();
+}
+
+/* Common exit point for the blocks handed to the user */
+static void *user_block(block_meta_t *block, size_t size)
+{
+	if (block->status == STATUS_ALLOC)
+		stats_heap_alloc(block->size);
+
+	prof_account_alloc(block, size);
+	return get_address_by_block(block);
+}
+
+int os_heap_profile_dump(const char *path)
+{
+	decay_lock();
+
+	int ret = prof_dump(path);
+
+	decay_unlock();
+	return ret;
+}
+
+int os_heap_dump(int fd)
+{
+	decay_lock();
+
+	int ret = heap_dump(fd);
 
+	decay_unlock();
+	return ret;
+}
+
+/* Resident set size, read from /proc without allocating, 0 if unavailable */
+static size_t read_rss(void)
+{
+	char buf[128];
+	int fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+		return 0;
+
+	ssize_t len = read(fd, buf, sizeof(buf) - 1);
+
+	close(fd);
+	if (len <= 0)
+		return 0;
+	buf[len] = '\0';
+
+	/* The second field is the number of resident pages */
+	char *p = strchr(buf, ' ');
+
+	return p ? strtoul(p + 1, NULL, 10) * sysconf(_SC_PAGESIZE) : 0;
+}
+
+void os_get_stats(os_mem_stats_t *stats)
+{
+	decay_lock();
+	*stats = mem_stats;
+	stats->mmap_threshold = mmap_threshold;
+	stats->mmap_threshold_max = mmap_threshold_max;
+	stats->buddy_internal_bytes = mem_stats.buddy_block_bytes - mem_stats.buddy_requested_bytes;
+
+	/* Quick list blocks are free for the purpose of fragmentation */
+	for (block_meta_t *iter = head; iter; iter = iter->next) {
+		if (iter->status != STATUS_FREE && iter->status != STATUS_QUICK)
+			continue;
+
+		size_t raw = get_raw_size(iter);
+
+		stats->heap_free_bytes += raw;
+		stats->heap_free_blocks++;
+		if (raw > stats->heap_largest_free)
+			stats->heap_largest_free = raw;
+	}
+	decay_unlock();
+
+	reclaim_stats(&stats->async_unmaps, &stats->reclaim_batches, &stats->reclaim_munmaps,
+		      &stats->reclaim_pending_bytes);
+	stats->rss_bytes = read_rss();
+}
+
+/* Find or make a block for size bytes, the way os_malloc places them. Blocks
+ * that may hold old data are reported as dirty, the fresh memory of the
+ * kernel is already zeroed
+ */
+static block_meta_t *malloc_block(size_t size, int *dirty)
+{
 	size_t raw_size = BLOCK_ALIGN + ALIGN(size);
 
 	block_meta_t *new_block;
 
+	*dirty = 1;
+
+	/* Mid-size blocks have a page heap of their own */
+	if (span_fits(raw_size)) {
+		new_block = alloc_span_block(size);
+		if (new_block) {
+			add_block(new_block);
+			return new_block;
+		}
+	}
+
 	/* Prealloc the heap if neccessary */
-	if (raw_size <= MMAP_THRESHOLD && prealloc_done == NOT_DONE) {
+	if (raw_size <= mmap_threshold && raw_size <= heap_prealloc_size &&
+	    prealloc_done == NOT_DONE) {
 		new_block = prealloc_heap();
-		DIE(!new_block, "malloc: failed heap preallocation\n");
+		if (!new_block)
+			return NULL;
 
 		/* Add block and split the preallocated area if there is enough size
 		 * remaining
 		 */
 		add_block(new_block);
-		if ((raw_size < MMAP_THRESHOLD) && (MMAP_THRESHOLD - raw_size >= MIN_SPACE))
+		if ((raw_size < heap_prealloc_size) &&
+		    (heap_prealloc_size - raw_size >= split_threshold))
 			split_block(new_block, size);
 		else
 			new_block->status = STATUS_ALLOC;
+		metadir_update(new_block);
 
 		/* Mark prealloc as done */
 		prealloc_done = DONE;
 
-		return get_address_by_block(new_block);
+		*dirty = 0;
+		return new_block;
 	}
 
+	/* Try the blocks whose coalescing was deferred */
+	block_meta_t *free_block = defer_coalesce ? quick_pop(size) : NULL;
+
+	if (free_block)
+		return free_block;
+
 	/* Try reusing blocks */
-	block_meta_t *free_block = reuse_block(size);
+	free_block = reuse_block(size);
 
 	if (free_block)
-		return get_address_by_block(free_block);
+		return free_block;
 
 	/* Alloc a new block */
-	new_block = alloc_new_block(size, MMAP_THRESHOLD);
-	DIE(!new_block, "malloc: failed allocation\n");
+	new_block = alloc_new_block(size, mmap_threshold);
+	if (!new_block)
+		return NULL;
 
 	add_block(new_block);
 
-	return get_address_by_block(new_block);
+	/* Buddy blocks are recycled, the other new blocks are fresh memory */
+	*dirty = !!(new_block->flags & BLOCK_FLAG_BUDDY);
+	return new_block;
 }
 
-void os_free(void *ptr)
+static void *do_malloc(size_t size)
 {
-	/* If pointer is NULL, do nothing */
-	if (ptr == NULL)
-		return;
+	/* If size is 0, return NULL and do nothing*/
+	if (size == 0)
+		return NULL;
 
-	block_meta_t *block = get_block_by_address(ptr);
+	/* The size of the block would wrap around */
+	if (size > MAX_PAYLOAD_SIZE)
+		return NULL;
+
+	int dirty;
+	block_meta_t *block = malloc_block(size, &dirty);
+
+	DIE(!block, "malloc: failed allocation\n");
+
+	return user_block(block, size);
+}
 
+/* Give a block back, without any accounting */
+static void release_block(block_meta_t *block)
+{
 	/* If the address was generated by mmap */
 	if (block->status == STATUS_MAPPED) {
+		update_mmap_threshold(block);
 		extract_block(block);
 		int ret = free_mmaped_block(block);
 
@@ -76,107 +223,209 @@ void os_free(void *ptr)
 
 	/* If the address was generated by sbrk */
 	if (block->status == STATUS_ALLOC) {
+		if (defer_coalesce && quick_push(block))
+			return;
+
 		mark_freed(block);
 		merge_free_blocks(block);
 	}
 }
 
-void *os_calloc(size_t nmemb, size_t size)
+static void do_free(void *ptr)
 {
-	/* If size is 0 */
-	if (!size || !nmemb)
-		return NULL;
+	/* If pointer is NULL, do nothing */
+	if (ptr == NULL)
+		return;
 
-	size_t raw_size = BLOCK_ALIGN + ALIGN(nmemb * size);
-	block_meta_t *new_block;
+	block_meta_t *block = get_block_by_address(ptr);
 
-	/* Preallocate the heap if neccessary */
-	if (raw_size <= PAGE_SIZE && prealloc_done == NOT_DONE) {
-		new_block = prealloc_heap();
-		memset_block(new_block, 0);
-		DIE(!new_block, "calloc: failed heap preallocation\n");
+	prof_account_free(block);
+	site_account_free(block);
+	if (block->status == STATUS_ALLOC)
+		stats_heap_free(block->size);
 
-		add_block(new_block);
-		if ((raw_size < PAGE_SIZE) && (PAGE_SIZE - raw_size >= MIN_SPACE))
-			split_block(new_block, nmemb * size);
-		else
-			new_block->status = STATUS_ALLOC;
+	release_block(block);
+}
 
-		/* Mark prealloc as done */
-		prealloc_done = DONE;
+static void *do_malloc_hint(size_t size, int hint)
+{
+	if (size == 0 || size > MAX_PAYLOAD_SIZE)
+		return NULL;
+
+	/* Huge blocks are mapped, no matter the threshold */
+	if (hint & OSMEM_HINT_HUGE) {
+		block_meta_t *new_block = alloc_new_block(size, 0);
 
-		return get_address_by_block(new_block);
+		DIE(!new_block, "malloc: failed allocation\n");
+		add_block(new_block);
+		mem_stats.hint_huge++;
+		return user_block(new_block, size);
 	}
 
-	if (raw_size > PAGE_SIZE) {
-		new_block = alloc_new_block(nmemb * size, PAGE_SIZE);
-		DIE(!new_block, "calloc: failed allocation\n");
+	/* Mapped sizes have nothing to place */
+	if (!(hint & (OSMEM_HINT_SHORT | OSMEM_HINT_LONG)) ||
+	    BLOCK_ALIGN + ALIGN(size) > mmap_threshold || span_fits(BLOCK_ALIGN + ALIGN(size)))
+		return do_malloc(size);
 
-		memset_block(new_block, 0);
-		add_block(new_block);
+	int long_lived = !!(hint & OSMEM_HINT_LONG);
 
-		return get_address_by_block(new_block);
-	}
+	if (long_lived)
+		mem_stats.hint_long++;
+	else
+		mem_stats.hint_short++;
 
-	block_meta_t *free_block = reuse_block(nmemb * size);
+	/* Long lived blocks have a heap of their own, away from the others. If
+	 * it can't grow, they are packed at the bottom of the main heap instead
+	 */
+	block_meta_t *block = long_lived ? long_alloc(size) : NULL;
 
-	if (free_block)
-		return memset_block(free_block, 0);
+	/* Before the main heap exists, there is nothing to place */
+	if (!block && prealloc_done == DONE)
+		block = place_by_lifetime(size, long_lived);
 
-	new_block = alloc_new_block(nmemb * size, PAGE_SIZE);
-	DIE(!new_block, "calloc: failed allocation\n");
+	/* Otherwise, the block comes from the top of the heap anyway */
+	if (!block)
+		return do_malloc(size);
 
-	memset_block(new_block, 0);
-	add_block(new_block);
+	return user_block(block, size);
+}
 
-	return get_address_by_block(new_block);
+/* os_malloc with lifetime prediction: the hint comes from the call site */
+static void *do_malloc_site(size_t size, uintptr_t pc)
+{
+	if (size == 0)
+		return NULL;
+
+	unsigned int idx = site_lookup(pc, size);
+	int hint = site_predict(idx);
+	void *ret = hint ? do_malloc_hint(size, hint) : do_malloc(size);
+
+	if (ret)
+		site_account_alloc(get_block_by_address(ret), idx);
+	return ret;
 }
 
-void *os_realloc(void *ptr, size_t size)
+static void *do_calloc(size_t nmemb, size_t size)
+{
+	/* If size is 0 */
+	if (!size || !nmemb)
+		return NULL;
+
+	/* The product, or the size of it's block, would wrap around */
+	if (nmemb > MAX_PAYLOAD_SIZE / size)
+		return NULL;
+
+	/* Placed like os_malloc, only the blocks with old data are cleared */
+	int dirty;
+	block_meta_t *block = malloc_block(nmemb * size, &dirty);
+
+	DIE(!block, "calloc: failed allocation\n");
+
+	if (dirty)
+		memset_block(block, 0);
+
+	return user_block(block, nmemb * size);
+}
+
+/* Exit point of os_realloc, counting the blocks that had to be moved and
+ * marking the ones that grew
+ */
+static void *realloc_done(block_meta_t *block, size_t size, int moved, int growing)
+{
+	if (moved)
+		mem_stats.realloc_moved++;
+	else
+		mem_stats.realloc_in_place++;
+
+	if (growing)
+		block->flags |= BLOCK_FLAG_GROWING;
+
+	return user_block(block, size);
+}
+
+static void *do_realloc(void *ptr, size_t size)
 {
 	if (!ptr && !size)
 		return NULL;
 
+	/* Too big for any block, the old one is left as it is */
+	if (size > MAX_PAYLOAD_SIZE)
+		return NULL;
+
 	/* When realloc is called as malloc, search for unused blocks first */
 	if (!ptr) {
 		block_meta_t *unused = reuse_block(size);
 
 		if (unused)
-			return get_address_by_block(unused);
+			return user_block(unused, size);
 		else
-			return os_malloc(size);
+			return do_malloc(size);
 	}
 
 	if (!size) {
-		os_free(ptr);
+		do_free(ptr);
 		return NULL;
 	}
 
 	block_meta_t *block = get_block_by_address(ptr);
+	size_t old_size = block->size;
 
-	if (block->status == STATUS_FREE)
+	if (block->status == STATUS_FREE || block->status == STATUS_QUICK)
 		return NULL;
 
+	/* For the heap profile and the statistics, a reallocation is a free
+	 * followed by a new allocation, no matter if the block is moved or not.
+	 * The result no longer belongs to the site that allocated the block
+	 */
+	prof_account_free(block);
+	site_account_free(block);
+	if (block->status == STATUS_ALLOC)
+		stats_heap_free(block->size);
+
+	/* A block grown twice in a row is probably a buffer that keeps growing,
+	 * it gets extra capacity. The flag is set again on the result
+	 */
+	int growing = size > old_size;
+	int repeated = growing && (block->flags & BLOCK_FLAG_GROWING);
+
+	block->flags &= ~BLOCK_FLAG_GROWING;
+
 	/* First, for mapped blocks, they should be reallocated, no matter the
 	 * new size, and the old block should be freed
 	 */
 	if (block->status == STATUS_MAPPED) {
+		/* Growing mappings are remapped, without copying, and long
+		 * lived blocks stay in place while the size fits
+		 */
+		if ((repeated && BLOCK_ALIGN + ALIGN(size) > mmap_threshold) ||
+		    (block->flags & BLOCK_FLAG_LONG)) {
+			block_meta_t *new_block = remap_block(block, size);
+
+			/* An out of line header stays put while the mapping moves,
+			 * so the payloads tell if the block was moved
+			 */
+			if (new_block)
+				return realloc_done(new_block, size,
+						    get_address_by_block(new_block) != ptr, growing);
+		}
+
 		block_meta_t *new_block = realloc_mapped_block(block, size);
 
 		DIE(!new_block, "realloc: failed allocation\n");
-		os_free(ptr);
-		return get_address_by_block(new_block);
+		memcpy(get_address_by_block(new_block), ptr, old_size < size ? old_size : size);
+		release_block(block);
+		return realloc_done(new_block, size, 1, growing);
 	}
 
 	/* If the heap block new size is much bigger, and it should be reallocated
 	 * using mmap
 	 */
-	if (ALIGN(size) + BLOCK_ALIGN > MMAP_THRESHOLD) {
+	if (ALIGN(size) + BLOCK_ALIGN > mmap_threshold) {
 		block_meta_t *new_block = move_to_mmap_space(block, size);
 
 		DIE(!new_block, "realloc: failed allocation\n");
-		os_free(ptr);
-		return get_address_by_block(new_block);
+		release_block(block);
+		return realloc_done(new_block, size, 1, growing);
 	}
 
 	/* If the size is smaller than all the memory allocated in block's memory,
@@ -186,48 +435,154 @@ void *os_realloc(void *ptr, size_t size)
 	size_t true_size = get_raw_size(block);
 
 	if (ALIGN(size) <= true_size) {
-		/* Split case */
-		if (true_size - ALIGN(size) >= MIN_SPACE) {
+		/* Split case, unless a growing block is using it's headroom */
+		if (true_size - ALIGN(size) >= split_threshold && !repeated) {
 			block->size = true_size;
 			split_block(block, size);
-			return ptr;
+			return realloc_done(block, size, 0, growing);
 		}
 
 		/* Truncate case */
 		block->size = size;
-		return ptr;
+		return realloc_done(block, size, 0, growing);
 	}
 
-	/* Check if memory can be expanded by expanding the heap */
-	if (!block->next) {
-		expand_heap(ALIGN(size) - true_size);
+	/* The capacity a moved or expanded block gets */
+	size_t capacity = repeated ? growth_capacity(size) : size;
+
+	/* Check if memory can be expanded by expanding the heap. When the heap
+	 * can't grow any more, the block has to move
+	 */
+	if (!block->next && expand_heap(ALIGN(capacity) - true_size)) {
 		block->size = size;
-		return ptr;
+		return realloc_done(block, size, 0, growing);
 	}
 
 	/* Try merging free blocks to reach the wanted size */
 	block_meta_t *merged_block = unite_blocks(block, size);
 
+	if (merged_block) {
+		merged_block->size = size;
+		return realloc_done(merged_block, size, 0, growing);
+	}
+
+	/* Try growing downwards, into a free predecessor, together with the
+	 * successors merged above
+	 */
+	merged_block = unite_with_prev(block, size, old_size);
+
 	if (merged_block)
-		return get_address_by_block(merged_block);
+		return realloc_done(merged_block, size, 0, growing);
 
 	/* Try to reuse free block */
-	block_meta_t *reused_block = reuse_block(size);
+	block_meta_t *reused_block = reuse_block(capacity);
 
 	if (reused_block) {
 		block->size = true_size;
 		copy_contents(block, reused_block);
-		os_free(ptr);
-		return get_address_by_block(reused_block);
+		release_block(block);
+		reused_block->size = size;
+		return realloc_done(reused_block, size, 1, growing);
 	}
 
 	/* Move to another zone */
-	block_meta_t *new_zone = alloc_new_block(size, MMAP_THRESHOLD);
+	block_meta_t *new_zone = alloc_new_block(capacity, mmap_threshold);
 
 	DIE(!new_zone, "realloc: allocation failed\n");
 	add_block(new_zone);
 	copy_contents(block, new_zone);
-	os_free(ptr);
+	release_block(block);
+	new_zone->size = size;
+
+	return realloc_done(new_zone, size, 1, growing);
+}
+
+/* The public entry points only add the call recording, and the lock of the
+ * decay purger, on top of the implementations above, so that the nested
+ * calls aren't recorded
+ */
+void *os_malloc(size_t size)
+{
+	if (__builtin_expect(!trace_enabled && !site_enabled && !decay_enabled, 1))
+		return do_malloc(size);
+
+	uint64_t start = trace_enabled ? trace_now() : 0;
+
+	decay_lock();
+
+	void *ret = site_enabled ?
+		    do_malloc_site(size, (uintptr_t)__builtin_return_address(0)) :
+		    do_malloc(size);
+
+	if (trace_enabled)
+		trace_record(TRACE_OP_MALLOC, start, 0, size, ret);
+	decay_unlock();
+	return ret;
+}
+
+void *os_malloc_hint(size_t size, int hint)
+{
+	if (__builtin_expect(!trace_enabled && !decay_enabled, 1))
+		return do_malloc_hint(size, hint);
+
+	uint64_t start = trace_enabled ? trace_now() : 0;
+
+	decay_lock();
+
+	void *ret = do_malloc_hint(size, hint);
+
+	if (trace_enabled)
+		trace_record(TRACE_OP_MALLOC_HINT, start, hint, size, ret);
+	decay_unlock();
+	return ret;
+}
+
+void os_free(void *ptr)
+{
+	if (__builtin_expect(!trace_enabled && !decay_enabled, 1)) {
+		do_free(ptr);
+		return;
+	}
+
+	uint64_t start = trace_enabled ? trace_now() : 0;
+
+	decay_lock();
+	do_free(ptr);
+	if (trace_enabled)
+		trace_record(TRACE_OP_FREE, start, (uintptr_t)ptr, 0, NULL);
+	decay_unlock();
+}
+
+void *os_calloc(size_t nmemb, size_t size)
+{
+	if (__builtin_expect(!trace_enabled && !decay_enabled, 1))
+		return do_calloc(nmemb, size);
+
+	uint64_t start = trace_enabled ? trace_now() : 0;
+
+	decay_lock();
+
+	void *ret = do_calloc(nmemb, size);
+
+	if (trace_enabled)
+		trace_record(TRACE_OP_CALLOC, start, nmemb, size, ret);
+	decay_unlock();
+	return ret;
+}
+
+void *os_realloc(void *ptr, size_t size)
+{
+	if (__builtin_expect(!trace_enabled && !decay_enabled, 1))
+		return do_realloc(ptr, size);
+
+	uint64_t start = trace_enabled ? trace_now() : 0;
+
+	decay_lock();
+
+	void *ret = do_realloc(ptr, size);
 
-	return get_address_by_block(new_zone);
+	if (trace_enabled)
+		trace_record(TRACE_OP_REALLOC, start, (uintptr_t)ptr, size, ret);
+	decay_unlock();
+	return ret;
 }
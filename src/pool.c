@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "osmem.h"
+
+os_pool_t *os_pool_create(size_t obj_size, size_t align)
+{
+	if (!align)
+		align = ALIGNMENT;
+
+	if (align & (align - 1)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* The free list link is kept inside the free objects */
+	if (align < sizeof(void *))
+		align = sizeof(void *);
+
+	if (!obj_size || align > POOL_SLAB_SIZE / 4 || obj_size > SIZE_MAX - (align - 1)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	size_t size = (obj_size + align - 1) & ~(align - 1);
+	size_t usable = POOL_SLAB_SIZE - sizeof(os_pool_slab_t) - (align - 1);
+
+	/* Every slab holds at least one object */
+	if (size > usable) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	size_t per_slab = usable / size;
+
+	os_pool_t *pool = os_malloc(sizeof(*pool));
+
+	if (!pool)
+		return NULL;
+
+	memset(pool, 0, sizeof(*pool));
+	pool->obj_size = size;
+	pool->align = align;
+	pool->per_slab = per_slab;
+	pool->stats.obj_size = size;
+
+	return pool;
+}
+
+static int add_slab(os_pool_t *pool)
+{
+	size_t len = sizeof(os_pool_slab_t) + pool->align - 1 + pool->per_slab * pool->obj_size;
+	os_pool_slab_t *slab = os_malloc(len);
+
+	if (!slab)
+		return -1;
+
+	slab->next = pool->slabs;
+	pool->slabs = slab;
+
+	/* The objects are carved lazily, so the slab's pages are only touched
+	 * when they are really used
+	 */
+	uintptr_t first = ((uintptr_t)(slab + 1) + pool->align - 1) & ~(uintptr_t)(pool->align - 1);
+
+	pool->next = (char *)first;
+	pool->end = pool->next + pool->per_slab * pool->obj_size;
+
+	pool->stats.slabs++;
+	pool->stats.capacity += pool->per_slab;
+	return 0;
+}
+
+void *os_pool_alloc(os_pool_t *pool)
+{
+	void *obj = pool->free_list;
+
+	if (obj) {
+		pool->free_list = *(void **)obj;
+	} else {
+		if (pool->next == pool->end && add_slab(pool))
+			return NULL;
+
+		obj = pool->next;
+		pool->next += pool->obj_size;
+	}
+
+	pool->stats.allocs++;
+	if (++pool->stats.in_use > pool->stats.peak_in_use)
+		pool->stats.peak_in_use = pool->stats.in_use;
+
+	return obj;
+}
+
+void os_pool_free(os_pool_t *pool, void *obj)
+{
+	if (!obj)
+		return;
+
+	*(void **)obj = pool->free_list;
+	pool->free_list = obj;
+
+	pool->stats.frees++;
+	pool->stats.in_use--;
+}
+
+void os_pool_get_stats(os_pool_t *pool, os_pool_stats_t *stats)
+{
+	*stats = pool->stats;
+}
+
+void os_pool_destroy(os_pool_t *pool)
+{
+	if (!pool)
+		return;
+
+	os_pool_slab_t *slab = pool->slabs;
+
+	while (slab) {
+		os_pool_slab_t *next = slab->next;
+
+		os_free(slab);
+		slab = next;
+	}
+
+	os_free(pool);
+}
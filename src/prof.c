@@ -0,0 +1,307 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "printf.h"
+#include "prof.h"
+
+/* Frames further apart than this are considered a broken frame chain */
+#define PROF_MAX_FRAME_SIZE (1024 * 1024)
+
+/* The counter never reaches zero while the profiler is disabled */
+ssize_t prof_bytes_left = SSIZE_MAX;
+
+/* Provided by the dynamic loader, the top of the main thread stack */
+extern void *__libc_stack_end;
+
+/* Provided by the linker, the bounds of the library's own code */
+extern char __ehdr_start[] __attribute__((visibility("hidden")));
+extern char __etext[] __attribute__((visibility("hidden")));
+
+static prof_bucket_t *buckets;
+static size_t used_buckets;
+static size_t sample_interval;
+static uint64_t rng_state;
+
+static char prof_prefix[PATH_MAX] = "osmem";
+static unsigned int dump_seq;
+static volatile sig_atomic_t dump_pending;
+
+static ssize_t next_interval(void)
+{
+	/* xorshift64*, the quality is more than enough for sampling */
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+
+	uint64_t r = rng_state * 0x2545F4914F6CDD1DULL;
+
+	/* Uniform value in (0, 1], turned into an exponential one, so the
+	 * sampling points form a Poisson process over the allocated bytes
+	 */
+	double u = ((r >> 11) + 1) * (1.0 / 9007199254740992.0);
+	double next = -log(u) * (double)sample_interval;
+
+	if (next >= (double)SSIZE_MAX)
+		return SSIZE_MAX;
+
+	return (ssize_t)next + 1;
+}
+
+static void __attribute__((noinline)) capture_stack(uintptr_t *pcs, int *depth)
+{
+	uintptr_t *fp = __builtin_frame_address(0);
+
+	*depth = 0;
+	while (fp && *depth < PROF_MAX_DEPTH) {
+		uintptr_t *next = (uintptr_t *)fp[0];
+		uintptr_t pc = fp[1];
+
+		if (!pc)
+			break;
+
+		/* The frames of the allocator itself are of no interest */
+		if (*depth || pc < (uintptr_t)__ehdr_start || pc >= (uintptr_t)__etext)
+			pcs[(*depth)++] = pc;
+
+		/* Stop at anything that doesn't look like a caller's frame */
+		if (next <= fp || (uintptr_t)next - (uintptr_t)fp > PROF_MAX_FRAME_SIZE)
+			break;
+		if ((uintptr_t)next & (sizeof(uintptr_t) - 1))
+			break;
+		if ((void *)fp < __libc_stack_end && (void *)next >= __libc_stack_end)
+			break;
+
+		fp = next;
+	}
+}
+
+static uint64_t hash_stack(uintptr_t *pcs, int depth)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	for (int i = 0; i < depth; i++) {
+		h ^= pcs[i];
+		h *= 0x100000001b3ULL;
+	}
+
+	/* Hash 0 marks empty buckets */
+	return h ? h : 1;
+}
+
+static size_t find_bucket(uintptr_t *pcs, int depth)
+{
+	uint64_t h = hash_stack(pcs, depth);
+	size_t idx = h % PROF_BUCKETS;
+
+	/* Bucket 0 is kept for the stacks that don't fit in the table anymore */
+	for (size_t probe = 0; probe < PROF_BUCKETS; probe++, idx = (idx + 1) % PROF_BUCKETS) {
+		if (!idx)
+			continue;
+
+		prof_bucket_t *b = &buckets[idx];
+
+		if (b->hash == h && b->depth == depth &&
+		    !memcmp(b->pcs, pcs, depth * sizeof(*pcs)))
+			return idx;
+
+		if (b->hash)
+			continue;
+
+		/* Keep the table at most 3/4 full, so the probes stay short */
+		if (used_buckets >= PROF_BUCKETS / 4 * 3)
+			break;
+
+		b->hash = h;
+		b->depth = depth;
+		memcpy(b->pcs, pcs, depth * sizeof(*pcs));
+		used_buckets++;
+		return idx;
+	}
+
+	return 0;
+}
+
+static void request_dump(int signum)
+{
+	(void)signum;
+
+	/* Dumping from the handler is not safe, the next allocation will do it */
+	dump_pending = 1;
+	prof_bytes_left = 0;
+}
+
+void prof_init(void)
+{
+	const char *env = getenv("OSMEM_PROF_SAMPLE");
+
+	if (!env || !atol(env))
+		return;
+
+	sample_interval = atol(env) == 1 ? PROF_DEFAULT_INTERVAL : (size_t)atol(env);
+
+	env = getenv("OSMEM_PROF_FILE");
+	if (env && *env)
+		snprintf(prof_prefix, sizeof(prof_prefix), "%s", env);
+
+	void *p = mmap(NULL, PROF_BUCKETS * sizeof(prof_bucket_t), PROT_READ | PROT_WRITE,
+		       MAP_ANON | MAP_PRIVATE, -1, 0);
+
+	DIE(p == MAP_FAILED, "prof: failed to map the bucket table\n");
+	buckets = p;
+
+	rng_state = ((uint64_t)getpid() << 32) ^ (uintptr_t)&rng_state ^ 0x9E3779B97F4A7C15ULL;
+	prof_bytes_left = next_interval();
+
+	env = getenv("OSMEM_PROF_SIGNAL");
+	if (env && atoi(env) > 0) {
+		struct sigaction sa;
+
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = request_dump;
+		sa.sa_flags = SA_RESTART;
+		DIE(sigaction(atoi(env), &sa, NULL), "prof: sigaction failed\n");
+	}
+}
+
+void prof_sample(block_meta_t *block)
+{
+	if (dump_pending) {
+		char path[PATH_MAX];
+
+		dump_pending = 0;
+		snprintf(path, sizeof(path), "%s.%d.%04u.heap", prof_prefix, getpid(), dump_seq++);
+		prof_dump(path);
+	}
+
+	/* Disabled profiler, just push the counter away again */
+	if (!buckets) {
+		prof_bytes_left = SSIZE_MAX;
+		return;
+	}
+
+	prof_bytes_left = next_interval();
+
+	uintptr_t pcs[PROF_MAX_DEPTH];
+	int depth;
+
+	capture_stack(pcs, &depth);
+
+	size_t idx = find_bucket(pcs, depth);
+	prof_bucket_t *b = &buckets[idx];
+
+	b->live_count++;
+	b->live_bytes += block->size;
+	b->alloc_count++;
+	b->alloc_bytes += block->size;
+
+	block->flags |= BLOCK_FLAG_SAMPLED | (unsigned int)(idx << PROF_BUCKET_SHIFT);
+}
+
+void prof_unsample(block_meta_t *block)
+{
+	prof_bucket_t *b = &buckets[(block->flags & PROF_BUCKET_MASK) >> PROF_BUCKET_SHIFT];
+
+	b->live_count--;
+	b->live_bytes -= block->size;
+
+	/* Clear the bucket index together with the flag */
+	block->flags &= ~(PROF_BUCKET_MASK | BLOCK_FLAG_SAMPLED);
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+	while (len) {
+		ssize_t ret = write(fd, buf, len);
+
+		if (ret < 0)
+			return -1;
+
+		buf += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+static int dump_maps(int fd)
+{
+	char buf[4096];
+	ssize_t ret;
+	int maps = open("/proc/self/maps", O_RDONLY);
+
+	if (maps < 0)
+		return -1;
+
+	while ((ret = read(maps, buf, sizeof(buf))) > 0) {
+		if (write_all(fd, buf, ret)) {
+			close(maps);
+			return -1;
+		}
+	}
+
+	close(maps);
+	return ret < 0 ? -1 : 0;
+}
+
+int prof_dump(const char *path)
+{
+	if (!buckets) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (fd < 0)
+		return -1;
+
+	/* The header holds the totals of all the buckets */
+	size_t live_count = 0, live_bytes = 0, alloc_count = 0, alloc_bytes = 0;
+
+	for (size_t i = 0; i < PROF_BUCKETS; i++) {
+		live_count += buckets[i].live_count;
+		live_bytes += buckets[i].live_bytes;
+		alloc_count += buckets[i].alloc_count;
+		alloc_bytes += buckets[i].alloc_bytes;
+	}
+
+	char line[64 + PROF_MAX_DEPTH * 20];
+	int len = snprintf(line, sizeof(line), "heap profile: %lu: %lu [%lu: %lu] @ heap_v2/%lu\n",
+			   live_count, live_bytes, alloc_count, alloc_bytes, sample_interval);
+
+	if (write_all(fd, line, len))
+		goto fail;
+
+	for (size_t i = 0; i < PROF_BUCKETS; i++) {
+		prof_bucket_t *b = &buckets[i];
+
+		if (!b->alloc_count)
+			continue;
+
+		len = snprintf(line, sizeof(line), "%lu: %lu [%lu: %lu] @",
+			       b->live_count, b->live_bytes, b->alloc_count, b->alloc_bytes);
+		for (int d = 0; d < b->depth; d++)
+			len += snprintf(line + len, sizeof(line) - len, " 0x%lx", b->pcs[d]);
+		len += snprintf(line + len, sizeof(line) - len, "\n");
+
+		if (write_all(fd, line, len))
+			goto fail;
+	}
+
+	/* pprof needs the mappings to symbolize the addresses */
+	if (write_all(fd, "\nMAPPED_LIBRARIES:\n", 19) || dump_maps(fd))
+		goto fail;
+
+	return close(fd);
+
+fail:
+	close(fd);
+	return -1;
+}
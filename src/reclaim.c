@@ -0,0 +1,180 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <linux/futex.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "config.h"
+#include "reclaim.h"
+
+/* Written at the start of a mapping that waits for the reclaimer */
+struct reclaim_node {
+	struct reclaim_node *next;
+	size_t length;
+};
+
+int reclaim_enabled;
+
+/* Mappings handed over, newest first. The producers push with a CAS, the
+ * reclaimer takes the whole list at once, so there is no ABA
+ */
+static struct reclaim_node *pending;
+static size_t pending_bytes;
+
+/* Set by the reclaimer before it waits on it, cleared by the first producer
+ * that sees it
+ */
+static int idle;
+
+static size_t total_queued, total_batches, total_unmaps;
+
+static void futex(int *addr, int op, int val)
+{
+	syscall(SYS_futex, addr, op, val, NULL, NULL, 0);
+}
+
+int reclaim_unmap(void *start, size_t length)
+{
+	if (__atomic_load_n(&pending_bytes, __ATOMIC_RELAXED) + length > RECLAIM_MAX_PENDING)
+		return munmap(start, length);
+
+	struct reclaim_node *node = start;
+
+	/* munmap takes whole pages, adjacent mappings are merged by their ends */
+	length = PAGE_ALIGN(length);
+
+	/* Counted before it's in the list, the reclaimer may take it right away */
+	__atomic_add_fetch(&pending_bytes, length, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&total_queued, 1, __ATOMIC_RELAXED);
+
+	node->length = length;
+	node->next = __atomic_load_n(&pending, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&pending, &node->next, node, 1,
+					    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+		;
+
+	/* Only the first free after a quiet time pays for the wake up */
+	if (__atomic_load_n(&idle, __ATOMIC_SEQ_CST) &&
+	    __atomic_exchange_n(&idle, 0, __ATOMIC_SEQ_CST))
+		futex(&idle, FUTEX_WAKE_PRIVATE, 1);
+
+	return 1;
+}
+
+/* Merge two address ordered lists */
+static struct reclaim_node *merge(struct reclaim_node *a, struct reclaim_node *b)
+{
+	struct reclaim_node *head = NULL, **tail = &head;
+
+	while (a && b) {
+		struct reclaim_node **min = a < b ? &a : &b;
+
+		*tail = *min;
+		tail = &(*min)->next;
+		*min = (*min)->next;
+	}
+	*tail = a ? a : b;
+
+	return head;
+}
+
+static struct reclaim_node *sort(struct reclaim_node *list)
+{
+	if (!list || !list->next)
+		return list;
+
+	struct reclaim_node *slow = list, *fast = list->next;
+
+	while (fast && fast->next) {
+		slow = slow->next;
+		fast = fast->next->next;
+	}
+
+	struct reclaim_node *half = slow->next;
+
+	slow->next = NULL;
+	return merge(sort(list), sort(half));
+}
+
+/* Unmap a batch, with one call per run of adjacent mappings. The nodes are
+ * read before the munmap that takes them away
+ */
+static void unmap_batch(struct reclaim_node *list)
+{
+	size_t total = 0;
+
+	for (list = sort(list); list;) {
+		char *start = (char *)list;
+		size_t length = list->length;
+
+		list = list->next;
+		while (list && (char *)list == start + length) {
+			length += list->length;
+			list = list->next;
+		}
+
+		/* Same as a failed munmap in os_free */
+		DIE(munmap(start, length), "reclaim: munmap failure\n");
+		total += length;
+		__atomic_add_fetch(&total_unmaps, 1, __ATOMIC_RELAXED);
+	}
+
+	__atomic_sub_fetch(&pending_bytes, total, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&total_batches, 1, __ATOMIC_RELAXED);
+}
+
+static void *reclaimer(void *arg)
+{
+	const struct timespec gather = { .tv_nsec = RECLAIM_BATCH_NS };
+
+	(void)arg;
+	for (;;) {
+		/* Let the frees gather, then take them all */
+		nanosleep(&gather, NULL);
+
+		struct reclaim_node *list = __atomic_exchange_n(&pending, NULL, __ATOMIC_SEQ_CST);
+
+		if (list) {
+			unmap_batch(list);
+			continue;
+		}
+
+		/* Sleep until a producer finds idle set, it may already have */
+		__atomic_store_n(&idle, 1, __ATOMIC_SEQ_CST);
+		if (!__atomic_load_n(&pending, __ATOMIC_SEQ_CST))
+			futex(&idle, FUTEX_WAIT_PRIVATE, 1);
+		__atomic_store_n(&idle, 0, __ATOMIC_SEQ_CST);
+	}
+
+	return NULL;
+}
+
+void reclaim_init(void)
+{
+	if (!env_size("OSMEM_ASYNC_MUNMAP", 0))
+		return;
+
+	/* The reclaimer takes no signals, they belong to the program's threads */
+	sigset_t all, old;
+	pthread_t thread;
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	if (!pthread_create(&thread, NULL, reclaimer, NULL)) {
+		pthread_detach(thread);
+		reclaim_enabled = 1;
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+void reclaim_stats(size_t *queued, size_t *batches, size_t *unmaps, size_t *waiting)
+{
+	*queued = __atomic_load_n(&total_queued, __ATOMIC_RELAXED);
+	*batches = __atomic_load_n(&total_batches, __ATOMIC_RELAXED);
+	*unmaps = __atomic_load_n(&total_unmaps, __ATOMIC_RELAXED);
+	*waiting = __atomic_load_n(&pending_bytes, __ATOMIC_RELAXED);
+}
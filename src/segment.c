@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <sys/mman.h>
+#include "block_meta.h"
+#include "segment.h"
+#include "stats.h"
+
+static heap_segment_t segments[SEGMENT_MAX];
+
+heap_segment_t *segment_create(size_t reserve)
+{
+	heap_segment_t *seg = NULL;
+
+	for (size_t i = 0; i < SEGMENT_MAX && !seg; i++)
+		if (!segments[i].base)
+			seg = &segments[i];
+
+	if (!seg || !reserve)
+		return NULL;
+
+	reserve = (reserve + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1);
+
+	/* Only addresses are taken, neither memory nor swap is accounted */
+	void *p = mmap(NULL, reserve, PROT_NONE, MAP_ANON | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+
+	if (p == MAP_FAILED)
+		return NULL;
+
+	mem_stats.segment_reserves++;
+	mem_stats.reserved_bytes += reserve;
+
+	seg->base = p;
+	seg->brk = p;
+	seg->committed = p;
+	seg->end = (char *)p + reserve;
+
+	return seg;
+}
+
+void *segment_sbrk(heap_segment_t *seg, size_t increment)
+{
+	char *old = seg->brk;
+
+	if (increment > (size_t)(seg->end - old))
+		return MAP_FAILED;
+
+	if (old + increment > seg->committed) {
+		size_t used = old + increment - seg->base;
+		size_t target = (used + SEGMENT_COMMIT_STEP - 1) & ~(size_t)(SEGMENT_COMMIT_STEP - 1);
+		char *new_committed = seg->base + target;
+
+		if (new_committed > seg->end)
+			new_committed = seg->end;
+
+		if (mprotect(seg->committed, new_committed - seg->committed, PROT_READ | PROT_WRITE))
+			return MAP_FAILED;
+
+		mem_stats.commit_calls++;
+		mem_stats.committed_bytes += new_committed - seg->committed;
+		seg->committed = new_committed;
+	}
+
+	seg->brk = old + increment;
+
+	return old;
+}
+
+void segment_destroy(heap_segment_t *seg)
+{
+	if (!seg->base)
+		return;
+
+	munmap(seg->base, seg->end - seg->base);
+
+	mem_stats.reserved_bytes -= seg->end - seg->base;
+	mem_stats.committed_bytes -= seg->committed - seg->base;
+	seg->base = NULL;
+}
@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "osmem.h"
+#include "site.h"
+
+int site_enabled;
+
+static site_t *sites;
+static uint64_t alloc_clock;
+
+void site_init(void)
+{
+	const char *env = getenv("OSMEM_LIFETIME_PREDICT");
+
+	if (!env || !atoi(env))
+		return;
+
+	void *p = mmap(NULL, SITE_TABLE_SIZE * sizeof(site_t), PROT_READ | PROT_WRITE,
+		       MAP_ANON | MAP_PRIVATE, -1, 0);
+
+	DIE(p == MAP_FAILED, "site: failed to map the site table\n");
+	sites = p;
+	site_enabled = 1;
+}
+
+unsigned int site_lookup(uintptr_t pc, size_t size)
+{
+	unsigned int size_class = 64 - __builtin_clzl(size | 1);
+	uint64_t h = (pc ^ ((uint64_t)size_class << 56)) * 0x9E3779B97F4A7C15ULL;
+	unsigned int idx = h >> 52;
+
+	/* Site 0 marks the blocks without a site */
+	for (size_t probe = 0; probe < SITE_TABLE_SIZE; probe++, idx = (idx + 1) % SITE_TABLE_SIZE) {
+		if (!idx)
+			continue;
+
+		site_t *s = &sites[idx];
+
+		if (s->pc == pc && s->size_class == size_class)
+			return idx;
+
+		if (s->pc)
+			continue;
+
+		/* Keep the table at most 3/4 full, so the probes stay short */
+		if (mem_stats.lifetime_sites >= SITE_TABLE_SIZE / 4 * 3)
+			return 0;
+
+		s->pc = pc;
+		s->size_class = size_class;
+		s->first_tick = alloc_clock;
+		mem_stats.lifetime_sites++;
+		return idx;
+	}
+
+	return 0;
+}
+
+int site_predict(unsigned int idx)
+{
+	site_t *s = &sites[idx];
+
+	if (!idx || s->allocs < SITE_MIN_ALLOCS)
+		return 0;
+
+	/* A site that keeps most of what it allocated is long lived, even if
+	 * it is too young for it's mean lifetime to show it
+	 */
+	if (s->live * 8 >= s->allocs * 7) {
+		mem_stats.predicted_long++;
+		return OSMEM_HINT_LONG;
+	}
+
+	uint64_t lifetime = s->live * (alloc_clock - s->first_tick) / s->allocs;
+
+	if (lifetime < SITE_SHORT_TICKS) {
+		mem_stats.predicted_short++;
+		return OSMEM_HINT_SHORT;
+	}
+
+	if (lifetime > SITE_LONG_TICKS) {
+		mem_stats.predicted_long++;
+		return OSMEM_HINT_LONG;
+	}
+
+	return 0;
+}
+
+void site_account_alloc(block_meta_t *block, unsigned int idx)
+{
+	alloc_clock++;
+	if (!idx)
+		return;
+
+	sites[idx].allocs++;
+	sites[idx].live++;
+	block->flags = (block->flags & ~SITE_MASK) | (idx << SITE_SHIFT);
+}
+
+void site_account_free(block_meta_t *block)
+{
+	unsigned int idx = (block->flags & SITE_MASK) >> SITE_SHIFT;
+
+	if (!idx)
+		return;
+
+	sites[idx].live--;
+	block->flags &= ~SITE_MASK;
+}
@@ -0,0 +1,269 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "config.h"
+#include "decay.h"
+#include "segment.h"
+#include "span.h"
+#include "stats.h"
+
+#define SPAN_NONE UINT32_MAX
+
+/* Spans with more pages than SPAN_MAX_PAGES share the list 0 */
+#define SPAN_LISTS (SPAN_MAX_PAGES + 1)
+
+/* Span map entry, one per page of the span heap. Only the first and the
+ * last page of a span are kept up to date, the links only on the first one
+ */
+struct span_entry {
+	uint32_t pages;
+	uint32_t prev;
+	uint32_t next;
+	uint32_t lru_prev;	/* Dirty free spans, the oldest first */
+	uint32_t lru_next;
+	uint32_t dirty;		/* Pages of a free span that may be committed */
+	uint32_t epoch;		/* Decay epoch the free span got dirty in */
+	uint32_t free;
+};
+
+int span_enabled;
+
+static heap_segment_t *span_segment;
+static struct span_entry *span_map;
+static uint32_t top;	/* Pages handed out by the segment */
+static uint32_t free_lists[SPAN_LISTS];
+static uint32_t lru_head = SPAN_NONE, lru_tail = SPAN_NONE;
+
+void span_init(void)
+{
+	span_enabled = env_size("OSMEM_SPAN_HEAP", 0) != 0;
+}
+
+static char *page_address(uint32_t page)
+{
+	return span_segment->base + (size_t)page * PAGE_SIZE;
+}
+
+static uint32_t list_of(uint32_t pages)
+{
+	return pages <= SPAN_MAX_PAGES ? pages : 0;
+}
+
+static void set_span(uint32_t page, uint32_t pages, int free, uint32_t dirty)
+{
+	struct span_entry *first = &span_map[page];
+	struct span_entry *last = &span_map[page + pages - 1];
+
+	first->pages = pages;
+	first->free = free;
+	first->dirty = dirty;
+	*last = *first;
+}
+
+static void push_free(uint32_t page, uint32_t pages, uint32_t dirty)
+{
+	uint32_t *list = &free_lists[list_of(pages)];
+
+	set_span(page, pages, 1, dirty);
+	span_map[page].prev = SPAN_NONE;
+	span_map[page].next = *list;
+	if (*list != SPAN_NONE)
+		span_map[*list].prev = page;
+	*list = page;
+
+	if (!dirty)
+		return;
+
+	/* A merged span takes the age of it's youngest part */
+	span_map[page].epoch = decay_epoch;
+	span_map[page].lru_prev = lru_tail;
+	span_map[page].lru_next = SPAN_NONE;
+	if (lru_tail != SPAN_NONE)
+		span_map[lru_tail].lru_next = page;
+	else
+		lru_head = page;
+	lru_tail = page;
+	decay_dirty_add(dirty);
+}
+
+static void unlink_free(uint32_t page)
+{
+	struct span_entry *span = &span_map[page];
+
+	if (span->prev != SPAN_NONE)
+		span_map[span->prev].next = span->next;
+	else
+		free_lists[list_of(span->pages)] = span->next;
+	if (span->next != SPAN_NONE)
+		span_map[span->next].prev = span->prev;
+
+	if (span->dirty) {
+		if (span->lru_prev != SPAN_NONE)
+			span_map[span->lru_prev].lru_next = span->lru_next;
+		else
+			lru_head = span->lru_next;
+		if (span->lru_next != SPAN_NONE)
+			span_map[span->lru_next].lru_prev = span->lru_prev;
+		else
+			lru_tail = span->lru_prev;
+		decay_dirty_sub(span->dirty);
+	}
+
+	span->free = 0;
+}
+
+/* Put a span in the free lists, merged with it's free neighbours */
+static void insert_free(uint32_t page, uint32_t pages, uint32_t dirty)
+{
+	uint32_t next = page + pages;
+
+	if (next < top && span_map[next].free) {
+		dirty += span_map[next].dirty;
+		pages += span_map[next].pages;
+		unlink_free(next);
+	}
+
+	if (page && span_map[page - 1].free) {
+		uint32_t prev = page - span_map[page - 1].pages;
+
+		dirty += span_map[prev].dirty;
+		pages += span_map[prev].pages;
+		page = prev;
+		unlink_free(prev);
+	}
+
+	/* Big free spans are decommitted whole, the pages come back zeroed. With
+	 * decay, the purger does it once they have aged
+	 */
+	if (!decay_enabled && dirty && pages >= SPAN_RELEASE_PAGES) {
+		madvise(page_address(page), (size_t)pages * PAGE_SIZE, MADV_DONTNEED);
+		mem_stats.span_decommits++;
+		mem_stats.span_decommitted_bytes += (size_t)pages * PAGE_SIZE;
+		dirty = 0;
+	}
+
+	push_free(page, pages, dirty);
+}
+
+static int grow(size_t pages)
+{
+	if (!span_segment) {
+		size_t map_len = SPAN_HEAP_RESERVE / PAGE_SIZE * sizeof(*span_map);
+		void *p = mmap(NULL, map_len, PROT_READ | PROT_WRITE,
+			       MAP_ANON | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+
+		if (p == MAP_FAILED)
+			return -1;
+
+		span_segment = segment_create(SPAN_HEAP_RESERVE);
+		if (!span_segment) {
+			munmap(p, map_len);
+			return -1;
+		}
+
+		span_map = p;
+		for (uint32_t i = 0; i < SPAN_LISTS; i++)
+			free_lists[i] = SPAN_NONE;
+	}
+
+	if (pages < SPAN_GROW_PAGES)
+		pages = SPAN_GROW_PAGES;
+
+	if (segment_sbrk(span_segment, pages * PAGE_SIZE) == MAP_FAILED)
+		return -1;
+
+	uint32_t page = top;
+
+	top += pages;
+	mem_stats.span_heap_bytes += pages * PAGE_SIZE;
+	insert_free(page, pages, 0);
+	return 0;
+}
+
+/* Smallest free span of at least the given size, or SPAN_NONE */
+static uint32_t find_free(size_t pages)
+{
+	for (size_t i = pages; i <= SPAN_MAX_PAGES; i++)
+		if (free_lists[i] != SPAN_NONE)
+			return free_lists[i];
+
+	uint32_t best = SPAN_NONE;
+
+	for (uint32_t page = free_lists[0]; page != SPAN_NONE; page = span_map[page].next)
+		if (best == SPAN_NONE || span_map[page].pages < span_map[best].pages)
+			best = page;
+
+	return best;
+}
+
+void *span_alloc(size_t pages)
+{
+	uint32_t page = span_segment ? find_free(pages) : SPAN_NONE;
+
+	if (page == SPAN_NONE) {
+		if (grow(pages))
+			return NULL;
+		page = find_free(pages);
+	}
+
+	uint32_t span_pages = span_map[page].pages;
+	uint32_t dirty = span_map[page].dirty;
+
+	/* The rest keeps as many dirty pages as it can hold */
+	unlink_free(page);
+	if (span_pages > pages)
+		push_free(page + pages, span_pages - pages,
+			  dirty < span_pages - pages ? dirty : span_pages - pages);
+
+	set_span(page, pages, 0, 0);
+
+	mem_stats.span_allocs++;
+	mem_stats.span_live_bytes += pages * PAGE_SIZE;
+	return page_address(page);
+}
+
+void span_free(void *p)
+{
+	uint32_t page = ((char *)p - span_segment->base) / PAGE_SIZE;
+	uint32_t pages = span_map[page].pages;
+
+	mem_stats.span_live_bytes -= (size_t)pages * PAGE_SIZE;
+	decay_freed(pages);
+	insert_free(page, pages, pages);
+}
+
+int span_oldest_dirty(uint32_t *epoch)
+{
+	if (lru_head == SPAN_NONE)
+		return 0;
+
+	*epoch = span_map[lru_head].epoch;
+	return 1;
+}
+
+void span_take_dirty(purge_extent_t *ext)
+{
+	uint32_t page = lru_head;
+	uint32_t pages = span_map[page].pages;
+
+	/* It looks allocated to it's neighbours until it comes back */
+	unlink_free(page);
+	set_span(page, pages, 0, 0);
+
+	ext->addr = page_address(page);
+	ext->len = (size_t)pages * PAGE_SIZE;
+	ext->source = DECAY_SOURCE_SPAN;
+	ext->cookie = ext->addr;
+	ext->run = pages;
+}
+
+void span_put_clean(purge_extent_t *ext)
+{
+	uint32_t page = ((char *)ext->cookie - span_segment->base) / PAGE_SIZE;
+
+	mem_stats.span_decommits++;
+	mem_stats.span_decommitted_bytes += ext->len;
+	insert_free(page, ext->run, 0);
+}
@@ -0,0 +1,114 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "block_meta.h"
+#include "trace.h"
+
+int trace_enabled;
+
+static int trace_fd = -1;
+static trace_rec_t *buffer;
+static size_t buffered;
+static uint64_t trace_start;
+static __thread uint32_t cached_tid;
+
+/* The callers record under the allocator lock when decay is enabled, which
+ * keeps the records in the order of the calls. The buffer has it's own lock
+ * for the other threads and for the flush at exit
+ */
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+uint64_t trace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void write_all(const void *buf, size_t len)
+{
+	const char *p = buf;
+
+	while (len) {
+		ssize_t ret = write(trace_fd, p, len);
+
+		DIE(ret < 0, "trace: write failed\n");
+		p += ret;
+		len -= ret;
+	}
+}
+
+static void flush_locked(void)
+{
+	if (!buffered)
+		return;
+
+	write_all(buffer, buffered * sizeof(trace_rec_t));
+	buffered = 0;
+}
+
+void trace_init(void)
+{
+	const char *path = getenv("OSMEM_TRACE_FILE");
+
+	if (!path || !*path)
+		return;
+
+	trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	DIE(trace_fd < 0, "trace: failed to open the trace file\n");
+
+	void *p = mmap(NULL, TRACE_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+
+	DIE(p == MAP_FAILED, "trace: failed to map the buffer\n");
+	buffer = p;
+
+	trace_header_t header;
+
+	memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+	header.version = TRACE_VERSION;
+	header.rec_size = sizeof(trace_rec_t);
+	write_all(&header, sizeof(header));
+
+	trace_start = trace_now();
+	trace_enabled = 1;
+}
+
+void trace_record(uint32_t op, uint64_t start, uint64_t ptr, uint64_t size, void *ret)
+{
+	if (!cached_tid)
+		cached_tid = (uint32_t)syscall(SYS_gettid);
+
+	pthread_mutex_lock(&trace_mutex);
+
+	trace_rec_t *rec = &buffer[buffered++];
+
+	rec->ts = start - trace_start;
+	rec->tid = cached_tid;
+	rec->op = op;
+	rec->ptr = ptr;
+	rec->size = size;
+	rec->ret = (uintptr_t)ret;
+
+	if (buffered == TRACE_BUFFER_SIZE / sizeof(trace_rec_t))
+		flush_locked();
+
+	pthread_mutex_unlock(&trace_mutex);
+}
+
+void trace_flush(void)
+{
+	if (!trace_enabled)
+		return;
+
+	pthread_mutex_lock(&trace_mutex);
+	flush_locked();
+	pthread_mutex_unlock(&trace_mutex);
+}
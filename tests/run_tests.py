@@ -50,6 +50,21 @@ TESTS = {
     "test-all": 5,
 }
 
+# Tests of the library's extensions, not graded, with the environment that
+# enables the feature they check
+EXTRA_TESTS = {
+    "test-arena": {},
+    "test-async-munmap": {"OSMEM_ASYNC_MUNMAP": "1"},
+    "test-buddy": {"OSMEM_BUDDY": "1", "OSMEM_MMAP_THRESHOLD_MAX": "1m"},
+    "test-decay": {"OSMEM_DECAY_MS": "64"},
+    "test-heap-dump": {},
+    "test-heap-reserve": {"OSMEM_HEAP_RESERVE": "64m"},
+    "test-malloc-hint": {},
+    "test-pool": {},
+    "test-span-heap": {"OSMEM_SPAN_HEAP": "1"},
+    "test-stats": {"OSMEM_MMAP_THRESHOLD_MAX": "1m"},
+}
+
 
 class UnfinishedCall(Exception):
     def __init__(self, *args: object) -> None:
@@ -74,23 +89,31 @@ class Call:
     def add_nested_calls(self, nested_calls: list = None) -> None:
         self.nested_calls = nested_calls.copy() if nested_calls else []
 
-    def prettify(self, heap_start, mmaps: dict) -> str:
+    def prettify(self, heap_start, mmaps: dict, ranges: list = ()) -> str:
         self.args = list(
             map(
-                lambda arg: self.interpret_addr(arg, heap_start, mmaps),
+                lambda arg: self.interpret_addr(arg, heap_start, mmaps, ranges),
                 self.args,
             )
         )
-        self.ret = self.interpret_addr(self.ret, heap_start, mmaps)
+        self.ret = self.interpret_addr(self.ret, heap_start, mmaps, ranges)
 
         if self.name == "mmap":
             self.interpret_mmap_args()
 
     @staticmethod
-    def interpret_addr(addr: str, heap_start: int, mmaps: dict) -> str:
+    def interpret_addr(addr: str, heap_start: int, mmaps: dict, ranges: list = ()) -> str:
         if "0x" in addr:
-            heap_addr = "HeapStart + " + hex(int(addr, 16) - heap_start)
-            return mmaps.get(addr, heap_addr)
+            if addr in mmaps:
+                return mmaps[addr]
+
+            # Blocks inside a bigger mapping (a heap segment) are named after
+            # it, the newest one first if the addresses were reused
+            for start, length, name in reversed(ranges):
+                if start <= int(addr, 16) < start + length:
+                    return f"{name} + {hex(int(addr, 16) - start)}"
+
+            return "HeapStart + " + hex(int(addr, 16) - heap_start)
 
         return addr
 
@@ -156,6 +179,7 @@ class LtraceParser:
         "brk",
         "mmap",
         "munmap",
+        "mremap",
     ]
 
     def __init__(self, program_output, output) -> None:
@@ -179,6 +203,7 @@ class LtraceParser:
         self.line_index = 0
 
         self.mmaps = {}
+        self.mmap_ranges = []
         self.mmaps_count = 1
         self.block_size = 0x20
 
@@ -216,6 +241,7 @@ class LtraceParser:
             line.startswith("brk")
             or line.startswith("mmap")
             or line.startswith("munmap")
+            or line.startswith("mremap")
         ):
             return False
 
@@ -243,14 +269,24 @@ class LtraceParser:
 
             if line.startswith(" "):
                 syscalls.append(Call(line.strip()))
-                if syscalls[-1].name == "mmap":
+                # A mapping resized in place keeps it's name
+                if syscalls[-1].name == "mmap" or (
+                    syscalls[-1].name == "mremap" and syscalls[-1].ret != syscalls[-1].args[0]
+                ):
                     payload_start = hex(int(syscalls[-1].ret, 16) + self.block_size)
                     self.mmaps[syscalls[-1].ret] = f"<mapped-addr{self.mmaps_count}>"
+                    self.mmap_ranges.append(
+                        (
+                            int(syscalls[-1].ret, 16),
+                            int(syscalls[-1].args[1 if syscalls[-1].name == "mmap" else 2]),
+                            f"<mapped-addr{self.mmaps_count}>",
+                        )
+                    )
                     self.mmaps[
                         payload_start
                     ] = f"<mapped-addr{self.mmaps_count}> + {hex(self.block_size)}"
                     self.mmaps_count += 1
-                syscalls[-1].prettify(self.heap_start, self.mmaps)
+                syscalls[-1].prettify(self.heap_start, self.mmaps, self.mmap_ranges)
 
             self.line_index += 1
 
@@ -259,7 +295,7 @@ class LtraceParser:
         except UnfinishedCall:
             return None
 
-        libcall.prettify(self.heap_start, self.mmaps)
+        libcall.prettify(self.heap_start, self.mmaps, self.mmap_ranges)
         libcall.add_nested_calls(syscalls)
 
         return libcall
@@ -293,7 +329,7 @@ class Test:
     SNIPPET_DIR = os.path.join(os.path.dirname(os.path.realpath(__file__)), "snippets")
     REF_DIR = os.path.join(os.path.dirname(os.path.realpath(__file__)), "ref")
 
-    def __init__(self, name, points) -> None:
+    def __init__(self, name, points, env=None) -> None:
         if "snippets/" in name:
             name = os.path.basename(name)
 
@@ -307,6 +343,7 @@ class Test:
 
         self.env = os.environ.copy()
         self.env["LD_LIBRARY_PATH"] = os.environ.get("SRC_PATH", Test.SRC_PATH)
+        self.env.update(env or {})
 
         print(self.name.ljust(33) + 24 * ".", end="")
 
@@ -462,7 +499,7 @@ def main():
     test_name, verbose, diff, memcheck = parse_args()
 
     if test_name:
-        test = Test(test_name, 1)
+        test = Test(test_name, 1, EXTRA_TESTS.get(os.path.basename(test_name)))
         test.run()
         test.grade(verbose, diff, memcheck)
         return
@@ -473,7 +510,14 @@ def main():
         if test.grade(verbose, diff, memcheck):
             total += score
 
+    passed = 0
+    for test_name, env in EXTRA_TESTS.items():
+        test = Test(test_name, 0, env)
+        test.run()
+        passed += bool(test.grade(verbose, diff, memcheck))
+
     print("\nTotal:" + " " * 59 + f" {total}/100")
+    print("Extensions:" + " " * 54 + f" {passed}/{len(EXTRA_TESTS)}")
 
 
 if __name__ == "__main__":
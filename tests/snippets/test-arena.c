@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdint.h>
+#include "test-utils.h"
+
+#define NUM_ALLOCS	64
+
+int main(void)
+{
+	void *prealloc_ptr, *ptr, *first;
+	os_arena_t *arena;
+
+	/* The chunks come from the preallocated heap, without syscalls */
+	prealloc_ptr = mock_preallocate();
+	os_free(prealloc_ptr);
+
+	/* Test the sizes whose blocks would wrap around */
+	FAIL(os_malloc(SIZE_MAX) != NULL, "DBG: os_malloc accepted a size that wraps");
+	FAIL(os_malloc(SIZE_MAX - METADATA_SIZE) != NULL, "DBG: os_malloc accepted a size that wraps");
+	FAIL(os_calloc(2, SIZE_MAX / 2) != NULL, "DBG: os_calloc accepted a size that wraps");
+
+	errno = 0;
+	FAIL(os_arena_create(SIZE_MAX) != NULL, "DBG: os_arena_create accepted a size that wraps");
+	FAIL(errno != ENOMEM, "DBG: os_arena_create didn't set ENOMEM");
+
+	arena = os_arena_create(1024);
+	FAIL(arena == NULL, "DBG: os_arena_create failed on a valid size");
+
+	errno = 0;
+	FAIL(os_arena_alloc(arena, 16, 3) != NULL, "DBG: os_arena_alloc accepted a bad alignment");
+	FAIL(errno != EINVAL, "DBG: os_arena_alloc didn't set EINVAL");
+
+	errno = 0;
+	FAIL(os_arena_alloc(arena, SIZE_MAX - 16, 0) != NULL, "DBG: os_arena_alloc accepted a size that wraps");
+	FAIL(errno != ENOMEM, "DBG: os_arena_alloc didn't set ENOMEM");
+
+	/* Test aligned allocations, past the first chunk */
+	first = os_arena_alloc(arena, 1, 0);
+	FAIL(first == NULL, "DBG: os_arena_alloc returned NULL");
+	for (int i = 0; i < NUM_ALLOCS; i++) {
+		ptr = os_arena_alloc(arena, 100, 64);
+		FAIL(ptr == NULL, "DBG: os_arena_alloc returned NULL");
+		FAIL((uintptr_t)ptr & 63, "DBG: os_arena_alloc returned an unaligned pointer");
+		memset(ptr, i, 100);
+	}
+
+	/* Test the reset arena starts over in a single chunk */
+	os_arena_reset(arena);
+	FAIL(arena->chunk->next != NULL, "DBG: os_arena_reset kept more than one chunk");
+	FAIL(arena->chunk->size < NUM_ALLOCS * 100, "DBG: os_arena_reset shrank the arena");
+
+	first = os_arena_alloc(arena, 1, 0);
+	for (int i = 0; i < NUM_ALLOCS; i++)
+		FAIL(os_arena_alloc(arena, 100, 64) == NULL, "DBG: os_arena_alloc returned NULL");
+	FAIL(arena->chunk->next != NULL, "DBG: the reset arena grew on the same cycle");
+
+	/* Test a reset of a single chunk rewinds it */
+	os_arena_reset(arena);
+	FAIL(os_arena_alloc(arena, 1, 0) != first, "DBG: os_arena_reset didn't rewind the chunk");
+
+	/* Cleanup */
+	os_arena_destroy(arena);
+
+	return 0;
+}
@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "test-utils.h"
+
+#define NUM_BLOCKS	4
+#define BIG_SIZE	(200 * MULT_KB)
+
+/* Wait for the reclaimer (OSMEM_ASYNC_MUNMAP) to unmap the freed blocks */
+static void wait_reclaim(os_mem_stats_t *stats)
+{
+	for (int i = 0; i < 200; i++) {
+		os_get_stats(stats);
+		if (!stats->reclaim_pending_bytes)
+			return;
+		usleep(10000);
+	}
+}
+
+int main(void)
+{
+	void *prealloc_ptr, *ptrs[NUM_BLOCKS], *ptr;
+	os_mem_stats_t stats;
+
+	prealloc_ptr = mock_preallocate();
+	os_free(prealloc_ptr);
+
+	for (int i = 0; i < NUM_BLOCKS; i++) {
+		ptrs[i] = os_malloc(BIG_SIZE);
+		memset(ptrs[i], i + 1, BIG_SIZE);
+	}
+
+	/* Test the freed blocks are handed to the reclaimer, the free itself
+	 * makes no munmap
+	 */
+	for (int i = 0; i < NUM_BLOCKS; i++)
+		os_free(ptrs[i]);
+	os_get_stats(&stats);
+	FAIL(stats.async_unmaps != NUM_BLOCKS, "DBG: the blocks weren't queued");
+	FAIL(stats.munmap_calls != 0, "DBG: a block was unmapped by it's free");
+
+	/* Test the reclaimer unmaps them in batches, the adjacent ones at once */
+	wait_reclaim(&stats);
+	FAIL(stats.reclaim_pending_bytes, "DBG: the queued blocks weren't unmapped");
+	FAIL(!stats.reclaim_batches || stats.reclaim_batches > NUM_BLOCKS, "DBG: wrong reclaim batches");
+	FAIL(!stats.reclaim_munmaps || stats.reclaim_munmaps > NUM_BLOCKS, "DBG: wrong reclaim munmaps");
+
+	/* Test a reallocated big block keeps it's data, and is queued once freed */
+	ptr = os_malloc(BIG_SIZE);
+	memset(ptr, 1, BIG_SIZE);
+	ptr = os_realloc(ptr, 2 * BIG_SIZE);
+	for (int i = 0; i < BIG_SIZE; i++)
+		FAIL(((char *)ptr)[i] != 1, "DBG: the reallocated block lost it's data");
+
+	os_get_stats(&stats);
+	size_t queued = stats.async_unmaps;
+
+	/* Cleanup */
+	os_free(ptr);
+	wait_reclaim(&stats);
+	FAIL(stats.async_unmaps != queued + 1 || stats.reclaim_pending_bytes, "DBG: the last block wasn't reclaimed");
+
+	return 0;
+}
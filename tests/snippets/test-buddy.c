@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "test-utils.h"
+
+#define BIG_SIZE	(200 * MULT_KB)
+#define ORDER_SIZE	(256 * MULT_KB)
+
+int main(void)
+{
+	void *prealloc_ptr, *ptr1, *ptr2, *ptr3;
+	os_mem_stats_t stats;
+
+	prealloc_ptr = mock_preallocate();
+	os_free(prealloc_ptr);
+
+	/* Test the blocks over the threshold are buddies in one region
+	 * (OSMEM_BUDDY), rounded up to a power of two
+	 */
+	ptr1 = os_malloc(BIG_SIZE);
+	ptr2 = os_malloc(BIG_SIZE);
+	FAIL((char *)ptr2 - (char *)ptr1 != ORDER_SIZE, "DBG: the blocks aren't buddies");
+
+	os_get_stats(&stats);
+	FAIL(stats.buddy_regions != 1 || stats.mmap_calls != 0, "DBG: the blocks weren't taken from a region");
+	FAIL(stats.buddy_allocs != 2 || stats.buddy_block_bytes != 2 * ORDER_SIZE, "DBG: wrong buddy blocks");
+	FAIL(stats.buddy_internal_bytes != 2 * (ORDER_SIZE - METADATA_SIZE - BIG_SIZE),
+	     "DBG: wrong internal fragmentation");
+
+	/* Test a block that keeps growing is resized within it's order */
+	ptr3 = os_realloc(ptr1, BIG_SIZE + 1000);
+	memset(ptr3, 1, BIG_SIZE + 1000);
+	FAIL(os_realloc(ptr3, BIG_SIZE + 2000) != ptr3, "DBG: the growing block was moved");
+
+	/* Test the freed buddies don't move the mmap threshold, they cost no
+	 * syscall (OSMEM_MMAP_THRESHOLD_MAX)
+	 */
+	os_free(ptr2);
+	os_free(ptr3);
+	os_get_stats(&stats);
+	FAIL(stats.mmap_threshold_updates != 0, "DBG: a buddy block moved the threshold");
+	FAIL(stats.buddy_block_bytes != 0, "DBG: buddy blocks left after free");
+
+	/* Test the freed blocks are reused */
+	ptr1 = os_malloc(BIG_SIZE);
+	os_get_stats(&stats);
+	FAIL(stats.buddy_regions != 1 || stats.buddy_allocs != 4, "DBG: the freed blocks weren't reused");
+
+	/* Cleanup */
+	os_free(ptr1);
+
+	return 0;
+}
@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "test-utils.h"
+
+#define NUM_BLOCKS	4
+#define BLOCK_SIZE	(16 * MULT_KB)
+
+/* Wait for the purger (OSMEM_DECAY_MS) to give back the dirty heap pages */
+static void wait_purge(os_mem_stats_t *stats)
+{
+	for (int i = 0; i < 200; i++) {
+		os_get_stats(stats);
+		if (!stats->heap_dirty_bytes)
+			return;
+		usleep(10000);
+	}
+}
+
+int main(void)
+{
+	void *prealloc_ptr, *ptrs[NUM_BLOCKS], *ptr;
+	os_mem_stats_t stats;
+
+	prealloc_ptr = mock_preallocate();
+	os_free(prealloc_ptr);
+
+	/* Test the freed heap is purged once it decays (OSMEM_DECAY_MS) */
+	wait_purge(&stats);
+	FAIL(stats.heap_dirty_bytes, "DBG: the heap wasn't purged");
+	FAIL(!stats.purge_calls || !stats.purged_bytes, "DBG: no purge was counted");
+
+	for (int i = 0; i < NUM_BLOCKS; i++) {
+		ptrs[i] = os_malloc(BLOCK_SIZE);
+		memset(ptrs[i], i + 1, BLOCK_SIZE);
+	}
+
+	/* Test the freed blocks keep their pages until they decay */
+	os_get_stats(&stats);
+	size_t purged = stats.purged_bytes, calls = stats.purge_calls;
+
+	for (int i = 0; i < NUM_BLOCKS; i++)
+		os_free(ptrs[i]);
+	os_get_stats(&stats);
+	FAIL(stats.heap_dirty_bytes < NUM_BLOCKS * BLOCK_SIZE - 2 * PAGE_SIZE, "DBG: the freed pages aren't dirty");
+
+	wait_purge(&stats);
+	FAIL(stats.heap_dirty_bytes, "DBG: the dirty pages didn't decay");
+	FAIL(stats.purge_calls == calls, "DBG: no purge was counted");
+	FAIL(stats.purged_bytes - purged < NUM_BLOCKS * BLOCK_SIZE - 2 * PAGE_SIZE, "DBG: wrong purged bytes");
+
+	/* Test the purged blocks are reused, and their pages are writable again */
+	ptr = os_malloc(BLOCK_SIZE);
+	FAIL(ptr != ptrs[0], "DBG: the purged block wasn't reused");
+	memset(ptr, 1, BLOCK_SIZE);
+
+	ptr = os_realloc(ptr, 2 * BLOCK_SIZE);
+	for (int i = 0; i < BLOCK_SIZE; i++)
+		FAIL(((char *)ptr)[i] != 1, "DBG: the reallocated block lost it's data");
+	os_get_stats(&stats);
+	FAIL(stats.heap_bytes != HEAP_PREALLOCATION_SIZE, "DBG: the heap grew");
+
+	/* Cleanup */
+	os_free(ptr);
+
+	return 0;
+}
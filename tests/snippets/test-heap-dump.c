@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdio.h>
+#include "test-utils.h"
+
+#define NUM_BLOCKS	4
+
+static char dump[4096];
+
+/* Dump the heap through a pipe and count it's block lines */
+static int take_dump(int *alloc_blocks, int *free_blocks, int *mapped_blocks)
+{
+	int fds[2], blocks = 0;
+	ssize_t len;
+
+	FAIL(pipe(fds), "DBG: pipe failed");
+	FAIL(os_heap_dump(fds[1]), "DBG: os_heap_dump failed");
+	close(fds[1]);
+	len = read(fds[0], dump, sizeof(dump) - 1);
+	FAIL(len <= 0, "DBG: empty heap dump");
+	dump[len] = '\0';
+	close(fds[0]);
+
+	*alloc_blocks = *free_blocks = *mapped_blocks = 0;
+	for (char *line = strtok(dump, "\n"); line; line = strtok(NULL, "\n")) {
+		char kind[8], status[8];
+		unsigned long header, align;
+		int version;
+
+		if (sscanf(line, "osmem-heap-dump %d", &version) == 1) {
+			FAIL(version != 2, "DBG: wrong heap dump version");
+		} else if (sscanf(line, "layout %lu %lu", &header, &align) == 2) {
+			FAIL(header != BLOCK_ALIGN || align != ALIGNMENT, "DBG: wrong heap dump layout");
+		} else if (sscanf(line, "block %7s %*s %*s %*s %7s", kind, status) == 2) {
+			blocks++;
+			if (!strcmp(status, "alloc"))
+				(*alloc_blocks)++;
+			else if (!strcmp(status, "free"))
+				(*free_blocks)++;
+			else if (!strcmp(status, "mapped"))
+				(*mapped_blocks)++;
+			FAIL(strcmp(kind, !strcmp(status, "mapped") ? "mmap" : "heap"), "DBG: wrong block kind");
+		}
+	}
+
+	return blocks;
+}
+
+int main(void)
+{
+	void *prealloc_ptr, *ptrs[NUM_BLOCKS], *big;
+	int alloc_blocks, free_blocks, mapped_blocks;
+
+	prealloc_ptr = mock_preallocate();
+	os_free(prealloc_ptr);
+
+	/* Test a single free heap block */
+	FAIL(take_dump(&alloc_blocks, &free_blocks, &mapped_blocks) != 1 || free_blocks != 1,
+	     "DBG: wrong dump of the preallocated heap");
+
+	for (int i = 0; i < NUM_BLOCKS; i++)
+		ptrs[i] = os_malloc(1000);
+	big = os_malloc(MMAP_THRESHOLD);
+
+	/* Test the split heap and the mapped block */
+	take_dump(&alloc_blocks, &free_blocks, &mapped_blocks);
+	FAIL(alloc_blocks != NUM_BLOCKS || free_blocks != 1 || mapped_blocks != 1,
+	     "DBG: wrong dump of the allocated blocks");
+
+	/* Test the freed blocks, without coalescing the ones apart, and the last
+	 * block grown over the free one after it
+	 */
+	os_free(ptrs[0]);
+	os_free(ptrs[2]);
+	ptrs[3] = os_realloc(ptrs[3], 2000);
+	take_dump(&alloc_blocks, &free_blocks, &mapped_blocks);
+	FAIL(alloc_blocks != NUM_BLOCKS - 2 || free_blocks != 2, "DBG: wrong dump of the freed blocks");
+
+	/* Cleanup */
+	os_free(big);
+	os_free(ptrs[1]);
+	os_free(ptrs[3]);
+	FAIL(take_dump(&alloc_blocks, &free_blocks, &mapped_blocks) != 1 || free_blocks != 1,
+	     "DBG: the freed heap wasn't coalesced");
+
+	return 0;
+}
@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "test-utils.h"
+
+#define RESERVE_SIZE	(64 * 1024 * 1024)
+#define COMMIT_STEP	(2 * 1024 * 1024)
+
+int main(void)
+{
+	void *prealloc_ptr, *ptr, *big;
+	os_mem_stats_t stats;
+
+	/* Test the heap is a reserved segment (OSMEM_HEAP_RESERVE), with the
+	 * first commit step accessible
+	 */
+	prealloc_ptr = mock_preallocate();
+	os_get_stats(&stats);
+	FAIL(stats.segment_reserves != 1 || stats.reserved_bytes != RESERVE_SIZE, "DBG: the heap wasn't reserved");
+	FAIL(stats.commit_calls != 1 || stats.committed_bytes != COMMIT_STEP, "DBG: wrong first commit");
+	FAIL(stats.brk_calls != 0, "DBG: the program break was moved");
+	os_free(prealloc_ptr);
+
+	/* Test the heap grows inside the committed memory without syscalls */
+	ptr = os_malloc(MMAP_THRESHOLD / 2);
+	big = os_malloc(MMAP_THRESHOLD / 2);
+	memset(big, 0, MMAP_THRESHOLD / 2);
+	os_get_stats(&stats);
+	FAIL(stats.commit_calls != 1, "DBG: memory committed twice");
+	FAIL(stats.heap_bytes <= HEAP_PREALLOCATION_SIZE, "DBG: the heap didn't grow");
+
+	/* Test a reallocation over the threshold leaves the segment for a mapping */
+	os_free(ptr);
+	big = os_realloc(big, COMMIT_STEP);
+	os_get_stats(&stats);
+	FAIL(stats.mmap_calls != 1, "DBG: the reallocated block wasn't mapped");
+	FAIL(stats.reserved_bytes != RESERVE_SIZE, "DBG: the reservation changed");
+
+	/* Test the long lived heap is a second segment, destroyed when it empties */
+	ptr = os_malloc_hint(100, OSMEM_HINT_LONG);
+	os_get_stats(&stats);
+	FAIL(stats.segment_reserves != 2, "DBG: the long lived heap isn't a segment");
+	os_free(ptr);
+	os_get_stats(&stats);
+	FAIL(stats.reserved_bytes != RESERVE_SIZE, "DBG: the long lived segment wasn't destroyed");
+	FAIL(stats.committed_bytes != COMMIT_STEP, "DBG: wrong committed bytes");
+
+	/* Cleanup */
+	os_free(big);
+
+	return 0;
+}
@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdint.h>
+#include "test-utils.h"
+
+#define NUM_BLOCKS	8
+
+int main(void)
+{
+	void *prealloc_ptr, *long_ptrs[NUM_BLOCKS], *short_ptrs[NUM_BLOCKS], *ptr;
+	size_t long_bytes = 0, short_bytes = 0;
+	os_mem_stats_t stats;
+
+	prealloc_ptr = mock_preallocate();
+	os_free(prealloc_ptr);
+
+	/* Test the long lived blocks are packed in a heap of their own, and the
+	 * short lived ones stay in the main heap
+	 */
+	for (int i = 0; i < NUM_BLOCKS; i++) {
+		long_ptrs[i] = os_malloc_hint(100 * (i + 1), OSMEM_HINT_LONG);
+		short_ptrs[i] = os_malloc_hint(100 * (i + 1), OSMEM_HINT_SHORT);
+		memset(long_ptrs[i], i, 100 * (i + 1));
+		memset(short_ptrs[i], i, 100 * (i + 1));
+		long_bytes += METADATA_SIZE + ALIGN(100 * (i + 1));
+		short_bytes += 100 * (i + 1);
+	}
+
+	for (int i = 1; i < NUM_BLOCKS; i++)
+		FAIL((char *)long_ptrs[i] != (char *)long_ptrs[i - 1] + METADATA_SIZE + ALIGN(100 * i),
+		     "DBG: long lived blocks aren't packed");
+
+	os_get_stats(&stats);
+	FAIL(stats.hint_long != NUM_BLOCKS || stats.hint_short != NUM_BLOCKS, "DBG: wrong hint counts");
+	FAIL(stats.long_live_bytes != long_bytes, "DBG: wrong long lived bytes");
+	FAIL(stats.heap_live_bytes != short_bytes, "DBG: short lived blocks outside of the heap");
+
+	/* Test a freed long lived block is reused first fit, and stays in place
+	 * when it's reallocated within it's capacity
+	 */
+	os_free(long_ptrs[1]);
+	ptr = os_malloc_hint(150, OSMEM_HINT_LONG);
+	FAIL(ptr != long_ptrs[1], "DBG: the freed long lived block wasn't reused");
+	FAIL(os_realloc(ptr, 50) != ptr, "DBG: the long lived block was moved");
+	for (int i = 0; i < NUM_BLOCKS; i++)
+		FAIL(*(char *)long_ptrs[i] != (char)i, "DBG: long lived blocks overlap");
+
+	/* Test the long lived heap is gone with it's last block */
+	for (int i = 0; i < NUM_BLOCKS; i++) {
+		os_free(long_ptrs[i]);
+		os_free(short_ptrs[i]);
+	}
+
+	os_get_stats(&stats);
+	FAIL(stats.long_heap_bytes || stats.long_live_bytes, "DBG: the long lived heap wasn't destroyed");
+	FAIL(stats.reserved_bytes, "DBG: the long lived segment wasn't unmapped");
+
+	return 0;
+}
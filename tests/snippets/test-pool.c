@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdint.h>
+#include "test-utils.h"
+
+#define NUM_OBJS	100
+
+static void check_invalid(size_t obj_size, size_t align)
+{
+	errno = 0;
+	FAIL(os_pool_create(obj_size, align) != NULL, "DBG: os_pool_create accepted invalid arguments");
+	FAIL(errno != EINVAL, "DBG: os_pool_create didn't set EINVAL");
+}
+
+int main(void)
+{
+	void *prealloc_ptr, *objs[NUM_OBJS];
+	os_pool_stats_t stats;
+	os_pool_t *pool;
+
+	/* The slabs come from the preallocated heap, without syscalls */
+	prealloc_ptr = mock_preallocate();
+	os_free(prealloc_ptr);
+
+	/* Test the invalid sizes and alignments */
+	check_invalid(0, 0);
+	check_invalid(24, 3);
+	check_invalid(24, POOL_SLAB_SIZE);
+	check_invalid(SIZE_MAX, 0);
+	check_invalid(SIZE_MAX - 8, 64);
+	check_invalid(POOL_SLAB_SIZE, 0);
+
+	pool = os_pool_create(24, 64);
+	FAIL(pool == NULL, "DBG: os_pool_create failed on valid arguments");
+
+	/* Test aligned, distinct objects */
+	for (int i = 0; i < NUM_OBJS; i++) {
+		objs[i] = os_pool_alloc(pool);
+		FAIL(objs[i] == NULL, "DBG: os_pool_alloc returned NULL");
+		FAIL((uintptr_t)objs[i] & 63, "DBG: os_pool_alloc returned an unaligned object");
+		memset(objs[i], i, 24);
+	}
+
+	for (int i = 0; i < NUM_OBJS; i++)
+		FAIL(*(char *)objs[i] != (char)i, "DBG: pool objects overlap");
+
+	/* Test the last freed object is reused first */
+	os_pool_free(pool, objs[10]);
+	os_pool_free(pool, objs[20]);
+	FAIL(os_pool_alloc(pool) != objs[20], "DBG: os_pool_alloc didn't reuse the last freed object");
+
+	os_pool_get_stats(pool, &stats);
+	FAIL(stats.obj_size != 64, "DBG: pool object size not rounded to the alignment");
+	FAIL(stats.slabs != 1, "DBG: pool took more than one slab");
+	FAIL(stats.in_use != NUM_OBJS - 1, "DBG: wrong pool objects in use");
+	FAIL(stats.peak_in_use != NUM_OBJS, "DBG: wrong pool peak");
+	FAIL(stats.allocs != NUM_OBJS + 1 || stats.frees != 2, "DBG: wrong pool counters");
+
+	/* Cleanup */
+	os_pool_destroy(pool);
+
+	return 0;
+}
@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "test-utils.h"
+
+#define MID_SIZE	10000
+#define MID_PAGES	3
+#define PAGE		4096
+
+int main(void)
+{
+	void *ptr1, *ptr2, *ptr3;
+	os_mem_stats_t stats;
+
+	/* Test the mid-size blocks take whole pages from the span heap
+	 * (OSMEM_SPAN_HEAP), next to each other
+	 */
+	ptr1 = os_malloc(MID_SIZE);
+	ptr2 = os_malloc(MID_SIZE);
+	FAIL((char *)ptr2 - (char *)ptr1 != MID_PAGES * PAGE, "DBG: the spans aren't contiguous");
+
+	os_get_stats(&stats);
+	FAIL(stats.span_allocs != 2 || stats.span_live_bytes != 2 * MID_PAGES * PAGE, "DBG: wrong spans");
+	FAIL(stats.heap_live_bytes != 0, "DBG: a mid-size block came from the heap");
+
+	/* Test a reallocation keeps the data in a span of the new size */
+	memset(ptr1, 1, MID_SIZE);
+	ptr3 = os_realloc(ptr1, 3 * MID_SIZE);
+	for (int i = 0; i < MID_SIZE; i++)
+		FAIL(((char *)ptr3)[i] != 1, "DBG: the reallocated span lost it's data");
+
+	os_get_stats(&stats);
+	FAIL(stats.span_live_bytes != (MID_PAGES + 8) * PAGE, "DBG: wrong spans after realloc");
+
+	/* Test the freed spans merge, and the big free span is decommitted */
+	os_free(ptr2);
+	os_free(ptr3);
+	os_get_stats(&stats);
+	FAIL(stats.span_live_bytes != 0, "DBG: spans left after free");
+	FAIL(stats.span_decommits == 0, "DBG: the free span wasn't decommitted");
+
+	/* Test the merged span is reused from it's start */
+	ptr2 = os_malloc(MID_SIZE);
+	FAIL(ptr2 != ptr1, "DBG: the merged span wasn't reused");
+
+	/* Cleanup */
+	os_free(ptr2);
+
+	return 0;
+}
@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "test-utils.h"
+
+#define BIG_SIZE	(200 * MULT_KB)
+
+int main(void)
+{
+	void *prealloc_ptr, *ptr;
+	os_mem_stats_t stats;
+
+	prealloc_ptr = mock_preallocate();
+	os_free(prealloc_ptr);
+
+	os_get_stats(&stats);
+	FAIL(stats.brk_calls != 1 || stats.mmap_calls != 0, "DBG: wrong syscall counts after the prealloc");
+	FAIL(stats.heap_bytes != HEAP_PREALLOCATION_SIZE, "DBG: wrong heap size after the prealloc");
+
+	/* Test a block over the threshold is mapped */
+	ptr = os_malloc(BIG_SIZE);
+	os_get_stats(&stats);
+	FAIL(stats.mmap_calls != 1, "DBG: the big block wasn't mapped");
+	FAIL(stats.mapped_bytes < BIG_SIZE, "DBG: wrong mapped bytes");
+
+	/* Test freeing it raises the dynamic threshold (OSMEM_MMAP_THRESHOLD_MAX) */
+	os_free(ptr);
+	os_get_stats(&stats);
+	FAIL(stats.munmap_calls != 1 || stats.mapped_bytes != 0, "DBG: the big block wasn't unmapped");
+	FAIL(stats.mmap_threshold_updates != 1, "DBG: the threshold wasn't updated");
+	FAIL(stats.mmap_threshold != BLOCK_ALIGN + ALIGN(BIG_SIZE), "DBG: wrong mmap threshold");
+
+	/* Test the same size now comes from the heap */
+	ptr = os_malloc(BIG_SIZE);
+	os_get_stats(&stats);
+	FAIL(stats.mmap_calls != 1, "DBG: the big block was mapped again");
+	FAIL(stats.brk_calls != 2, "DBG: the heap wasn't expanded");
+	FAIL(stats.heap_live_bytes != BIG_SIZE, "DBG: wrong live heap bytes");
+
+	/* Test a shrinking reallocation stays in place */
+	FAIL(os_realloc(ptr, 300) != ptr, "DBG: the shrunk block was moved");
+	os_get_stats(&stats);
+	FAIL(stats.realloc_in_place != 1 || stats.realloc_moved != 0, "DBG: wrong reallocation counts");
+	FAIL(stats.heap_live_bytes != 300, "DBG: wrong live heap bytes after realloc");
+
+	/* Cleanup */
+	os_free(ptr);
+	os_get_stats(&stats);
+	FAIL(stats.heap_live_bytes != 0, "DBG: live heap bytes left after free");
+	FAIL(stats.peak_heap_live_bytes < BIG_SIZE, "DBG: wrong live heap peak");
+
+	return 0;
+}
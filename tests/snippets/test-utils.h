@@ -77,14 +77,28 @@ void *os_malloc_checked(size_t size)
 
 void *os_realloc_checked(void *ptr, size_t size)
 {
+	/* Heap payloads stay under the threshold. The snapshot must not make
+	 * syscalls of it's own, they would show up in the traces
+	 */
+	static char snapshot[MMAP_THRESHOLD];
 	void *ptr_realloc;
 	struct block_meta oldBlock;
+	size_t len = 0;
 
 	if (!ptr)
 		return os_realloc(ptr, size);
 
 	memcpy(&oldBlock, ptr - sizeof(struct block_meta), sizeof(oldBlock));
 
+	/* The payload can be moved within the old block's memory, so it is
+	 * compared with a copy taken before the call
+	 */
+	if (oldBlock.status == STATUS_ALLOC) {
+		len = MIN(oldBlock.size, size);
+		FAIL(len > sizeof(snapshot), "DBG: os_realloc_checked snapshot too small");
+		memcpy(snapshot, ptr, len);
+	}
+
 	ptr_realloc = os_realloc(ptr, size);
 
 	if (size == 0) {
@@ -95,8 +109,8 @@ void *os_realloc_checked(void *ptr, size_t size)
 		return ptr_realloc;
 	}
 
-	if (oldBlock.status == STATUS_ALLOC)
-		FAIL(memcmp(ptr_realloc, ptr, MIN(oldBlock.size, size)) != 0, "DBG: os_realloc corrupted memory");
+	if (len)
+		FAIL(memcmp(ptr_realloc, snapshot, len) != 0, "DBG: os_realloc corrupted memory");
 
 	return ptr_realloc;
 }
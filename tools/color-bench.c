@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+/*
+ * Shows the cache set conflicts of same-size mapped buffers, and what the
+ * cache colouring of OSMEM_CACHE_COLOR does to them.
+ *
+ * A number of equal buffers, all above the mmap threshold, are allocated
+ * and scanned column by column: the same offset of every buffer, then the
+ * next offset. Without colouring, all the payloads start at the same page
+ * offset, so the lines of one column fall in the same cache sets, and they
+ * evict each other before the scan comes back to them. The scan is timed
+ * and, when the kernel lets us, the L1 data cache misses are counted.
+ */
+
+#include <getopt.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "osmem.h"
+
+#define MAX_BUFFERS 1024
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Counter of the L1 data cache read misses, or -1 if there is no PMU */
+static int open_l1_misses(void)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [-n buffers] [-s size] [-r rounds]\n", prog);
+	printf("  -n  number of buffers (default 64)\n");
+	printf("  -s  size of a buffer (default 256k)\n");
+	printf("  -r  number of scans (default 20)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	size_t buffers = 64, size = 256 * 1024, rounds = 20;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:s:r:h")) != -1) {
+		if (opt == 'n' && atol(optarg) > 0 && atol(optarg) <= MAX_BUFFERS) {
+			buffers = atol(optarg);
+		} else if (opt == 's' && atol(optarg) > 0) {
+			size = atol(optarg);
+		} else if (opt == 'r' && atol(optarg) > 0) {
+			rounds = atol(optarg);
+		} else {
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	static double *buf[MAX_BUFFERS];
+	size_t offsets[PAGE_SIZE / CACHE_LINE_SIZE] = { 0 };
+	size_t colors = 0;
+
+	for (size_t b = 0; b < buffers; b++) {
+		buf[b] = os_malloc(size);
+		DIE(!buf[b], "os_malloc");
+
+		/* Distinct page offsets are distinct cache colours */
+		size_t line = ((uintptr_t)buf[b] & (PAGE_SIZE - 1)) / CACHE_LINE_SIZE;
+
+		if (!offsets[line]++)
+			colors++;
+
+		for (size_t i = 0; i < size / sizeof(double); i++)
+			buf[b][i] = (double)i;
+	}
+
+	int fd = open_l1_misses();
+	uint64_t misses = 0;
+	double sum = 0;
+
+	if (fd >= 0) {
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+
+	uint64_t t = now();
+
+	for (size_t r = 0; r < rounds; r++)
+		for (size_t i = 0; i < size / sizeof(double); i++)
+			for (size_t b = 0; b < buffers; b++)
+				sum += buf[b][i];
+
+	t = now() - t;
+
+	if (fd >= 0) {
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(fd, &misses, sizeof(misses)) != sizeof(misses))
+			fd = -1;
+	}
+
+	size_t loads = rounds * buffers * (size / sizeof(double));
+
+	printf("buffers:     %lu x %lu bytes, %lu colours\n", buffers, size, colors);
+	printf("column scan: %.2f ns per load (checksum %g)\n", (double)t / loads, sum);
+	if (fd >= 0)
+		printf("L1D misses:  %lu (%.3f per load)\n", misses, (double)misses / loads);
+	else
+		printf("L1D misses:  not available\n");
+
+	for (size_t b = 0; b < buffers; b++)
+		os_free(buf[b]);
+
+	return 0;
+}
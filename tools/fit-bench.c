@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+/*
+ * Compares the best fit search of find_best_block, which follows the block
+ * headers through the heap, with the packed size array kernels of
+ * fitsearch.h that the metadata directory uses.
+ *
+ * For every heap size, a fake heap is laid out in an anonymous mapping,
+ * with headers separated by their payloads and about half of the blocks
+ * free. The same random requests are then served by every search, and
+ * their results are checked against each other.
+ */
+
+#include <getopt.h>
+#include <sys/mman.h>
+#include <time.h>
+#include "osmem.h"
+#include "fitsearch.h"
+
+#define QUERIES 4096
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t rng(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+static void *map_anon(size_t len)
+{
+	void *p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+
+	DIE(p == MAP_FAILED, "mmap");
+	return p;
+}
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* The best fit loop of find_best_block */
+static block_meta_t *list_search(block_meta_t *head, size_t size)
+{
+	block_meta_t *return_block = NULL;
+
+	for (block_meta_t *iter = head; iter; iter = iter->next) {
+		if (iter->status != STATUS_FREE || ALIGN(iter->size) < ALIGN(size))
+			continue;
+
+		if (ALIGN(iter->size) <= ALIGN(size))
+			return iter;
+
+		if (!return_block || ALIGN(return_block->size) > ALIGN(iter->size))
+			return_block = iter;
+	}
+
+	return return_block;
+}
+
+static void run(size_t blocks, size_t max_size)
+{
+	size_t heap_len = blocks * (BLOCK_ALIGN + ALIGN(max_size));
+	char *heap = map_anon(heap_len);
+	block_meta_t **addr = map_anon(blocks * sizeof(*addr));
+	uint32_t *fit_sizes = map_anon(blocks * sizeof(*fit_sizes));
+	size_t *queries = map_anon(QUERIES * sizeof(*queries));
+	size_t *expected = map_anon(QUERIES * sizeof(*expected));
+	char *p = heap;
+
+	for (size_t i = 0; i < blocks; i++) {
+		block_meta_t *block = (block_meta_t *)p;
+
+		block->size = ALIGN(1 + rng() % max_size);
+		block->status = rng() % 2 ? STATUS_FREE : STATUS_ALLOC;
+		block->flags = 0;
+		block->prev = i ? addr[i - 1] : NULL;
+		block->next = NULL;
+		if (i)
+			addr[i - 1]->next = block;
+
+		addr[i] = block;
+		fit_sizes[i] = block->status == STATUS_FREE ? block->size / ALIGNMENT : 0;
+		p += BLOCK_ALIGN + block->size;
+	}
+
+	/* Most requests fit somewhere, some fit nowhere */
+	for (size_t q = 0; q < QUERIES; q++)
+		queries[q] = 1 + rng() % (max_size + max_size / 8);
+
+	uint64_t t = now();
+
+	for (size_t q = 0; q < QUERIES; q++) {
+		block_meta_t *block = list_search(addr[0], queries[q]);
+
+		expected[q] = block ? (size_t)(block - (block_meta_t *)heap) : (size_t)-1;
+	}
+
+	t = now() - t;
+	printf("%8lu  %10.1f", blocks, (double)t / QUERIES);
+
+	for (int kind = FIT_SEARCH_SCALAR; kind <= FIT_SEARCH_AVX2; kind++) {
+		fit_search_fn search = fit_search_kernel(kind);
+
+		if (!search) {
+			printf("  %10s", "-");
+			continue;
+		}
+
+		t = now();
+		for (size_t q = 0; q < QUERIES; q++) {
+			uint32_t need = ALIGN(queries[q]) / ALIGNMENT;
+			size_t i = search(fit_sizes, blocks, need, need);
+			size_t got = i == blocks ? (size_t)-1 : (size_t)(addr[i] - (block_meta_t *)heap);
+
+			DIE(got != expected[q], "fit-bench: the searches disagree");
+		}
+		t = now() - t;
+		printf("  %10.1f", (double)t / QUERIES);
+	}
+	printf("\n");
+
+	munmap(heap, heap_len);
+	munmap(addr, blocks * sizeof(*addr));
+	munmap(fit_sizes, blocks * sizeof(*fit_sizes));
+	munmap(queries, QUERIES * sizeof(*queries));
+	munmap(expected, QUERIES * sizeof(*expected));
+}
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [-s max-size]\n", prog);
+	printf("  -s  largest block size (default 4096)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	size_t max_size = 4096;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:h")) != -1) {
+		if (opt == 's' && atol(optarg) > 0) {
+			max_size = atol(optarg);
+		} else {
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	printf("ns per best fit search, %d requests up to %lu bytes\n", QUERIES,
+	       max_size + max_size / 8);
+	printf("%8s  %10s  %10s  %10s  %10s\n", "blocks", "list", "scalar", "sse4.1", "avx2");
+
+	for (size_t blocks = 64; blocks <= 64 * 1024; blocks *= 4)
+		run(blocks, max_size);
+
+	return 0;
+}
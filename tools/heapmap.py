@@ -0,0 +1,229 @@
+"""Render a heap dump written by os_heap_dump() as an HTML/SVG heap map.
+
+The fragmentation metrics are printed to stdout, the map is written to the
+file given with -o.
+"""
+
+import argparse
+import html
+import sys
+
+# Header size and alignment of the dumps without a layout line (version 1)
+DEFAULT_LAYOUT = (32, 16)
+ROW_WIDTH = 1024
+ROW_HEIGHT = 14
+COLORS = {
+    "header": "#9e9e9e",
+    "alloc": "#4a90d9",
+    "slack": "#f5a623",
+    "free": "#7ed321",
+    "quick": "#b8e986",
+}
+
+
+class Block:
+    def __init__(self, fields: list) -> None:
+        self.kind = fields[1]
+        self.offset = int(fields[2], 0)
+        self.size = int(fields[3])
+        self.raw_size = int(fields[4])
+        self.status = fields[5]
+
+    @property
+    def slack(self) -> int:
+        """Payload space the block owns, but doesn't use."""
+        if self.status in ("free", "quick"):
+            return 0
+        return max(self.raw_size - self.size, 0)
+
+
+def parse_dump(lines: list) -> tuple:
+    if not lines or not lines[0].startswith("osmem-heap-dump"):
+        raise ValueError("not an osmem heap dump")
+
+    heap_start, heap_end = 0, 0
+    layout = DEFAULT_LAYOUT
+    blocks = []
+    for line in lines[1:]:
+        fields = line.split()
+        if not fields:
+            continue
+        if fields[0] == "layout":
+            layout = (int(fields[1]), int(fields[2]))
+        elif fields[0] == "heap":
+            heap_start, heap_end = int(fields[1], 0), int(fields[2], 0)
+        elif fields[0] == "block":
+            blocks.append(Block(fields))
+
+    return heap_end - heap_start, blocks, layout
+
+
+def histogram(sizes: list) -> dict:
+    """Count the sizes in power of two buckets, keyed by the bucket's lower bound."""
+    buckets = {}
+    for size in sizes:
+        bucket = 1 << max(size.bit_length() - 1, 0)
+        buckets[bucket] = buckets.get(bucket, 0) + 1
+    return dict(sorted(buckets.items()))
+
+
+def metrics(heap_size: int, blocks: list, layout: tuple) -> dict:
+    header_size, alignment = layout
+    heap = [b for b in blocks if b.kind == "heap"]
+    mapped = [b for b in blocks if b.kind == "mmap"]
+    long_lived = [b for b in blocks if b.kind == "long" and b.status == "alloc"]
+    free = [b.raw_size for b in heap if b.status == "free"]
+    quick = [b.raw_size for b in heap if b.status == "quick"]
+    total_free = sum(free)
+
+    return {
+        "header size": header_size,
+        "alignment": alignment,
+        "heap size": heap_size,
+        "heap blocks": len(heap),
+        "allocated bytes": sum(b.size for b in heap if b.status == "alloc"),
+        "free bytes": total_free,
+        "free blocks": len(free),
+        "quick list bytes": sum(quick),
+        "quick list blocks": len(quick),
+        "largest free block": max(free, default=0),
+        "external fragmentation": 1 - max(free, default=0) / total_free if total_free else 0.0,
+        "truncation slack": sum(b.slack for b in heap),
+        "metadata bytes": header_size * len(heap),
+        "mapped blocks": len(mapped),
+        "mapped bytes": sum(b.raw_size + header_size for b in mapped),
+        "long lived blocks": len(long_lived),
+        "long lived bytes": sum(b.size for b in long_lived),
+        "free size histogram": histogram(free),
+    }
+
+
+def segments(blocks: list, header_size: int) -> list:
+    """Split the heap blocks in colored (offset, length, kind, block) segments."""
+    segs = []
+    for b in blocks:
+        if b.kind != "heap":
+            continue
+        segs.append((b.offset, header_size, "header", b))
+        start = b.offset + header_size
+        if b.status in ("free", "quick"):
+            segs.append((start, b.raw_size, b.status, b))
+        else:
+            segs.append((start, b.raw_size - b.slack, "alloc", b))
+            segs.append((start + b.raw_size - b.slack, b.slack, "slack", b))
+    return [s for s in segs if s[1] > 0]
+
+
+def render_map(heap_size: int, blocks: list, header_size: int, row_bytes: int) -> str:
+    rows = max((heap_size + row_bytes - 1) // row_bytes, 1)
+    scale = ROW_WIDTH / row_bytes
+    out = [
+        f'<svg xmlns="http://www.w3.org/2000/svg" width="{ROW_WIDTH + 90}" '
+        f'height="{rows * (ROW_HEIGHT + 2)}">'
+    ]
+    for row in range(rows):
+        out.append(
+            f'<text x="0" y="{row * (ROW_HEIGHT + 2) + ROW_HEIGHT - 3}" '
+            f'font-size="10" font-family="monospace">{hex(row * row_bytes)}</text>'
+        )
+
+    for offset, length, kind, b in segments(blocks, header_size):
+        # Blocks that cross the end of a row continue on the next one
+        while length > 0:
+            row, col = divmod(offset, row_bytes)
+            part = min(length, row_bytes - col)
+            title = html.escape(
+                f"{b.status} block at {hex(b.offset)}: size {b.size}, raw size {b.raw_size}"
+            )
+            out.append(
+                f'<rect x="{90 + col * scale:.2f}" y="{row * (ROW_HEIGHT + 2)}" '
+                f'width="{max(part * scale, 0.5):.2f}" height="{ROW_HEIGHT}" '
+                f'fill="{COLORS[kind]}"><title>{title}</title></rect>'
+            )
+            offset += part
+            length -= part
+
+    out.append("</svg>")
+    return "\n".join(out)
+
+
+def render_histogram(hist: dict) -> str:
+    if not hist:
+        return "<p>No free blocks.</p>"
+
+    top = max(hist.values())
+    bar_width = 48
+    out = [
+        f'<svg xmlns="http://www.w3.org/2000/svg" width="{len(hist) * bar_width + 10}" height="140">'
+    ]
+    for i, (bucket, count) in enumerate(hist.items()):
+        height = 100 * count / top
+        x = i * bar_width + 5
+        out.append(
+            f'<rect x="{x}" y="{110 - height:.1f}" width="{bar_width - 6}" '
+            f'height="{height:.1f}" fill="{COLORS["free"]}"><title>{count}</title></rect>'
+        )
+        out.append(f'<text x="{x}" y="125" font-size="10">{bucket}</text>')
+        out.append(f'<text x="{x}" y="{105 - height:.1f}" font-size="10">{count}</text>')
+    out.append("</svg>")
+    return "\n".join(out)
+
+
+def render_html(heap_size: int, blocks: list, stats: dict, row_bytes: int) -> str:
+    rows = "\n".join(
+        f"<tr><td>{name}</td><td>{value:.3f}</td></tr>"
+        if isinstance(value, float)
+        else f"<tr><td>{name}</td><td>{value}</td></tr>"
+        for name, value in stats.items()
+        if not isinstance(value, dict)
+    )
+    legend = " ".join(
+        f'<span style="background:{color};padding:0 8px">{kind}</span>'
+        for kind, color in COLORS.items()
+    )
+    return f"""<!DOCTYPE html>
+<html>
+<head><meta charset="utf-8"><title>osmem heap map</title></head>
+<body style="font-family:sans-serif">
+<h2>Metrics</h2>
+<table>{rows}</table>
+<h2>Free block sizes</h2>
+{render_histogram(stats["free size histogram"])}
+<h2>Heap map ({row_bytes} bytes per row)</h2>
+<p>{legend}</p>
+{render_map(heap_size, blocks, stats["header size"], row_bytes)}
+</body>
+</html>
+"""
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("dump", nargs="?", default="-", help="heap dump file, - for stdin")
+    parser.add_argument("-o", "--output", help="where to write the HTML heap map")
+    parser.add_argument("-r", "--row-bytes", type=int, default=16384, help="heap bytes per map row")
+    args = parser.parse_args()
+
+    if args.dump == "-":
+        lines = sys.stdin.read().splitlines()
+    else:
+        with open(args.dump, "r", encoding="ascii") as fin:
+            lines = fin.read().splitlines()
+
+    heap_size, blocks, layout = parse_dump(lines)
+    stats = metrics(heap_size, blocks, layout)
+
+    for name, value in stats.items():
+        if isinstance(value, dict):
+            value = ", ".join(f"{k}+: {v}" for k, v in value.items()) or "-"
+        elif isinstance(value, float):
+            value = f"{value:.3f}"
+        print(f"{name + ':':<25} {value}")
+
+    if args.output:
+        with open(args.output, "w", encoding="ascii") as fout:
+            fout.write(render_html(heap_size, blocks, stats, args.row_bytes))
+
+
+if __name__ == "__main__":
+    main()
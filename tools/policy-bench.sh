@@ -0,0 +1,48 @@
+#!/bin/bash
+# SPDX-License-Identifier: BSD-3-Clause
+
+# Compare the placement policies (OSMEM_PLACEMENT) and split thresholds
+# (OSMEM_SPLIT_THRESHOLD) by replaying the same traces with each of them.
+# The traces of the test snippets are recorded first; more trace files can be
+# given as arguments.
+#
+# Usage: ./policy-bench.sh [-s "<split thresholds>"] [trace files...]
+
+SCRIPT_DIR=$(cd "$(dirname "$0")" && pwd)
+SRC_PATH=$(realpath "$SCRIPT_DIR/../src")
+SNIPPETS_PATH=$(realpath "$SCRIPT_DIR/../tests/snippets")
+POLICIES="best first next good"
+SPLITS="48"
+
+if test "$1" = "-s"; then
+    SPLITS="$2"
+    shift 2
+fi
+
+make -s -C "$SCRIPT_DIR" >/dev/null || exit 1
+make -s -C "$SCRIPT_DIR/../tests" snippets >/dev/null || exit 1
+
+TRACE_DIR=$(mktemp -d)
+trap 'rm -rf "$TRACE_DIR"' EXIT
+
+for snippet in "$SNIPPETS_PATH"/test-*; do
+    test -x "$snippet" || continue
+    name=$(basename "$snippet")
+    OSMEM_TRACE_FILE="$TRACE_DIR/$name.trace" LD_LIBRARY_PATH="$SRC_PATH" \
+        "$snippet" >/dev/null 2>&1
+done
+
+printf "%-8s %-6s %-32s %12s %14s\n" "policy" "split" "trace" "ops/s" "footprint KiB"
+
+for trace in "$TRACE_DIR"/*.trace "$@"; do
+    for policy in $POLICIES; do
+        for split in $SPLITS; do
+            out=$(OSMEM_PLACEMENT=$policy OSMEM_SPLIT_THRESHOLD=$split \
+                LD_LIBRARY_PATH="$SRC_PATH" "$SCRIPT_DIR/replay" -n "$trace")
+            ops=$(echo "$out" | awk '/^throughput:/ { print $2 }')
+            footprint=$(echo "$out" | awk '/^footprint:/ { print $2 }')
+            printf "%-8s %-6s %-32s %12s %14s\n" "$policy" "$split" \
+                "$(basename "$trace" .trace)" "${ops:--}" "${footprint:--}"
+        done
+    done
+done
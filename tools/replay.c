@@ -0,0 +1,277 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+/*
+ * Replays a trace recorded with OSMEM_TRACE_FILE against libosmem.so and
+ * reports the throughput, the latency percentiles, the peak RSS and the
+ * memory the allocator took from the kernel.
+ *
+ * The calls are executed in the recorded order, on a single thread. The
+ * tool itself never uses the libc allocator, so that it doesn't fight with
+ * libosmem over the program break.
+ */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "osmem.h"
+#include "trace.h"
+
+/* Recorded address -> replayed address, open addressing, linear probing */
+struct id_slot {
+	uint64_t id;
+	void *ptr;
+};
+
+static struct id_slot *ids;
+static size_t ids_mask;
+
+static void *map_anon(size_t len)
+{
+	void *p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+
+	DIE(p == MAP_FAILED, "mmap");
+	return p;
+}
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static size_t id_hash(uint64_t id)
+{
+	return (size_t)((id >> 4) * 0x9E3779B97F4A7C15ULL) & ids_mask;
+}
+
+static void id_insert(uint64_t id, void *ptr)
+{
+	size_t i = id_hash(id);
+
+	while (ids[i].id && ids[i].id != id)
+		i = (i + 1) & ids_mask;
+
+	ids[i].id = id;
+	ids[i].ptr = ptr;
+}
+
+/* Returns the replayed pointer of the id and forgets about it */
+static void *id_remove(uint64_t id)
+{
+	size_t i = id_hash(id);
+
+	while (ids[i].id && ids[i].id != id)
+		i = (i + 1) & ids_mask;
+
+	if (!ids[i].id)
+		return NULL;
+
+	void *ptr = ids[i].ptr;
+
+	/* Backward shift deletion, so that no tombstones are needed */
+	size_t j = i;
+
+	for (;;) {
+		ids[i].id = 0;
+		do {
+			j = (j + 1) & ids_mask;
+			if (!ids[j].id)
+				return ptr;
+		} while (((j - id_hash(ids[j].id)) & ids_mask) < ((j - i) & ids_mask));
+
+		ids[i] = ids[j];
+		i = j;
+	}
+}
+
+static void radix_sort(uint64_t *v, uint64_t *tmp, size_t n)
+{
+	for (int shift = 0; shift < 64; shift += 16) {
+		static size_t count[1 << 16];
+
+		memset(count, 0, sizeof(count));
+		for (size_t i = 0; i < n; i++)
+			count[(v[i] >> shift) & 0xffff]++;
+
+		size_t sum = 0;
+
+		for (size_t i = 0; i < (1 << 16); i++) {
+			size_t c = count[i];
+
+			count[i] = sum;
+			sum += c;
+		}
+
+		for (size_t i = 0; i < n; i++)
+			tmp[count[(v[i] >> shift) & 0xffff]++] = v[i];
+
+		memcpy(v, tmp, n * sizeof(*v));
+	}
+}
+
+static void touch(void *ptr, size_t size)
+{
+	/* Fault the pages in, the way the traced program would have */
+	for (size_t off = 0; ptr && off < size; off += 4096)
+		((volatile char *)ptr)[off] = 0;
+}
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [-n] <trace-file>\n", prog);
+	printf("  -n  don't touch the allocated memory\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int do_touch = 1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "nh")) != -1) {
+		if (opt == 'n') {
+			do_touch = 0;
+		} else {
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	int fd = open(argv[optind], O_RDONLY);
+
+	DIE(fd < 0, "open");
+
+	struct stat st;
+
+	DIE(fstat(fd, &st), "fstat");
+	if ((size_t)st.st_size < sizeof(trace_header_t)) {
+		printf("%s: not a trace file\n", argv[optind]);
+		return 1;
+	}
+
+	void *file = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	DIE(file == MAP_FAILED, "mmap");
+
+	trace_header_t *header = file;
+
+	if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) ||
+	    header->version != TRACE_VERSION || header->rec_size != sizeof(trace_rec_t)) {
+		printf("%s: unsupported trace file\n", argv[optind]);
+		return 1;
+	}
+
+	trace_rec_t *recs = (trace_rec_t *)(header + 1);
+	size_t n = (st.st_size - sizeof(*header)) / sizeof(trace_rec_t);
+
+	/* There are never more live ids than records */
+	size_t slots = 1024;
+
+	while (slots < 2 * n)
+		slots <<= 1;
+	ids = map_anon(slots * sizeof(*ids));
+	ids_mask = slots - 1;
+
+	uint64_t *lat = map_anon((n + 1) * sizeof(*lat));
+	uint64_t *tmp = map_anon((n + 1) * sizeof(*tmp));
+	size_t done = 0, skipped = 0;
+	uint64_t busy = 0;
+	uint64_t wall = now();
+
+	for (size_t i = 0; i < n; i++) {
+		trace_rec_t *r = &recs[i];
+		void *old = NULL, *p = NULL;
+		uint64_t t0, t1;
+
+		/* Calls on blocks allocated before the recording started */
+		if ((r->op == TRACE_OP_FREE || r->op == TRACE_OP_REALLOC) && r->ptr) {
+			old = id_remove(r->ptr);
+			if (!old) {
+				skipped++;
+				continue;
+			}
+		}
+
+		switch (r->op) {
+		case TRACE_OP_MALLOC:
+			t0 = now();
+			p = os_malloc(r->size);
+			t1 = now();
+			break;
+		case TRACE_OP_MALLOC_HINT:
+			t0 = now();
+			p = os_malloc_hint(r->size, (int)r->ptr);
+			t1 = now();
+			break;
+		case TRACE_OP_CALLOC:
+			t0 = now();
+			p = os_calloc(r->ptr, r->size);
+			t1 = now();
+			break;
+		case TRACE_OP_REALLOC:
+			t0 = now();
+			p = os_realloc(old, r->size);
+			t1 = now();
+			break;
+		case TRACE_OP_FREE:
+			t0 = now();
+			os_free(old);
+			t1 = now();
+			break;
+		default:
+			printf("record %lu: unknown operation %u\n", i, r->op);
+			return 1;
+		}
+
+		lat[done++] = t1 - t0;
+		busy += t1 - t0;
+
+		if (r->ret && p) {
+			id_insert(r->ret, p);
+			if (do_touch)
+				touch(p, r->op == TRACE_OP_CALLOC ? r->ptr * r->size : r->size);
+		}
+	}
+
+	wall = now() - wall;
+
+	struct rusage ru;
+
+	DIE(getrusage(RUSAGE_SELF, &ru), "getrusage");
+
+	printf("trace:       %s\n", argv[optind]);
+	printf("operations:  %lu (%lu skipped)\n", done, skipped);
+	if (!done)
+		return 0;
+
+	radix_sort(lat, tmp, done);
+
+	printf("wall time:   %lu us\n", wall / 1000);
+	printf("alloc time:  %lu us\n", busy / 1000);
+	printf("throughput:  %lu ops/s\n", (unsigned long)(done * 1000000000.0 / (busy ? busy : 1)));
+	printf("latency ns:  mean %lu p50 %lu p90 %lu p99 %lu p99.9 %lu max %lu\n",
+	       busy / done, lat[done / 2], lat[done * 90 / 100], lat[done * 99 / 100],
+	       lat[done * 999 / 1000], lat[done - 1]);
+	printf("peak RSS:    %ld KiB\n", ru.ru_maxrss);
+
+	/* The heap never shrinks, so it's final size is also it's peak */
+	os_mem_stats_t stats;
+
+	os_get_stats(&stats);
+	printf("footprint:   %lu KiB (heap %lu KiB, peak mapped %lu KiB)\n",
+	       (stats.heap_bytes + stats.peak_mapped_bytes) >> 10, stats.heap_bytes >> 10,
+	       stats.peak_mapped_bytes >> 10);
+
+	return 0;
+}
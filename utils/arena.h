@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Chunk size used when os_arena_create is called with 0 */
+#define ARENA_DEFAULT_SIZE (64 * 1024)
+
+/* Structure placed at the start of every arena chunk, followed by the
+ * chunk's data
+ */
+struct os_arena_chunk {
+	struct os_arena_chunk *next;	/* Previously filled chunk */
+	size_t size;			/* Size of the data, without this header */
+};
+typedef struct os_arena_chunk os_arena_chunk_t;
+
+/* Structure to hold a bump-pointer arena. Allocations are carved from the
+ * current chunk, and are all released at once by os_arena_reset
+ */
+struct os_arena {
+	os_arena_chunk_t *chunk;	/* Current chunk, head of the chunk list */
+	char *ptr;			/* First free byte of the current chunk */
+	char *end;			/* End of the current chunk */
+	size_t capacity;		/* Total data size of all the chunks */
+};
+typedef struct os_arena os_arena_t;
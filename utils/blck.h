@@ -10,6 +10,16 @@
 #include <string.h>
 #include "printf.h"
 #include "block_meta.h"
+#include "buddy.h"
+#include "config.h"
+#include "decay.h"
+#include "longheap.h"
+#include "mapped.h"
+#include "metadir.h"
+#include "reclaim.h"
+#include "segment.h"
+#include "span.h"
+#include "stats.h"
 
 /**
  * @brief Head of the Memory List
@@ -46,14 +56,6 @@ block_meta_t *get_last_heap();
  */
 block_meta_t *get_heap_start();
 
-/**
- * @brief Get the last block allocated using mmap
- * 
- * @return block_meta_t* The last block allocated using mmap, or NULL in case
- * there are only blocks on heap
- */
-block_meta_t *get_last_mmap();
-
 /**
  * @brief Get the last block from global Memory List
  * 
@@ -63,7 +65,8 @@ block_meta_t *get_last_mmap();
 block_meta_t *get_last_block();
 
 /**
- * @brief Insert in Memory List a block allocated using mmap syscall
+ * @brief Register a block allocated using mmap syscall. Mapped blocks are
+ * not linked in the Memory List, they go in the registry of mapped.h
  * 
  * @param block The block that was previously verified to be allocated using
  * mmap
@@ -100,7 +103,7 @@ block_meta_t* split_block(block_meta_t *unused_block, size_t payload_size);
 
 /**
  * @brief Unlink the block from other blocks, and relink the prev and next
- * pointers, if they exist
+ * pointers, if they exist. Mapped blocks are removed from the registry
  * 
  * @param block The block to be removed. It works for any block, but is
  * designed only for mmaped blocks.
@@ -108,9 +111,11 @@ block_meta_t* split_block(block_meta_t *unused_block, size_t payload_size);
 void extract_block(block_meta_t *block);
 
 /**
- * @brief Find the smallest unused block that can be split into 2 separate
- * blocks, and the remaining memory of the second one can be reused for future
- * allocations.
+ * @brief Find an unused block that can hold size bytes, chosen by the
+ * placement policy: the smallest one (best fit, the default), the lowest one
+ * (first fit), the first one after the last found block (next fit), or the
+ * first one within good_fit_percent of the size, falling back to the
+ * smallest one (good fit).
  * 
  * @param size The size of the new memory chunk we want to add to the list.
  * @return block_meta_t* A pointer to the found block, or NULL, if none of
@@ -141,15 +146,42 @@ void *alloc_raw_memory(size_t raw_size, alloc_type_t syscall_type);
  */
 block_meta_t *alloc_new_block(size_t payload_size, size_t limit);
 
+/**
+ * @brief Allocates a block from the span heap. It is a mapped block, kept in
+ * the registry, that starts a run of whole pages
+ *
+ * @param payload_size The size that can be used for storing some data
+ * @return block_meta_t* Pointer to the new block, or NULL in case the span
+ * heap can't grow
+ */
+block_meta_t *alloc_span_block(size_t payload_size);
+
 /**
  * @brief Preallocates a size of 128 kB on heap (including the size of block
- * structure )
+ * structure ), or the growth floor in adaptive mode
  * 
- * @return block_meta_t* Pointer to the block that contains the 128 kB
+ * @return block_meta_t* Pointer to the block that contains the memory
  * preallocated on heap, or NULL in case of allocation fails
  */
 block_meta_t *prealloc_heap();
 
+/**
+ * @brief Move the end of the main heap up: the program break, or the break
+ * of the heap segment when OSMEM_HEAP_RESERVE is set. The segment is
+ * reserved on the first call
+ *
+ * @param size The additional memory in bytes
+ * @return void* Previous end of the heap, or MAP_FAILED on failure
+ */
+void *heap_sbrk(size_t size);
+
+/**
+ * @brief Get the end of the main heap, the equivalent of sbrk(0)
+ *
+ * @return void* The end of the heap, or NULL before there is a heap segment
+ */
+void *heap_end(void);
+
 /**
  * @brief Expand the heap with size bytes
  * 
@@ -158,6 +190,26 @@ block_meta_t *prealloc_heap();
  */
 void *expand_heap(size_t size);
 
+/**
+ * @brief Compute the size of the next heap expansion, in adaptive mode. The
+ * step doubles when the previous one was used up by new allocations, halves
+ * when the heap grows only rarely, is at least 1/8 of the peak live heap and
+ * stays between the configured floor and ceiling
+ *
+ * @param min_size The raw size the expansion should provide at least
+ * @return size_t The expansion size in bytes
+ */
+size_t heap_growth_step(size_t min_size);
+
+/**
+ * @brief Expand the heap by a growth step, in adaptive mode. The new memory
+ * is added to the tail if it is free, or becomes a new free block
+ *
+ * @param min_size The raw size the expansion should provide at least
+ * @return block_meta_t* The free tail of the heap, or NULL in case of failure
+ */
+block_meta_t *grow_heap(size_t min_size);
+
 /**
  * @brief Reuse blocks that are free. The functions does more than that, it
  * splits a block if it is too big, expand the heap to make room for new
@@ -179,6 +231,33 @@ block_meta_t *reuse_block(size_t size);
  */
 void mark_freed(block_meta_t *block);
 
+/**
+ * @brief Put a freed heap block in the quick list of it's size, without
+ * coalescing it. The lists are consolidated when they hold more than
+ * quick_max_bytes
+ *
+ * @param block The heap block that is freed
+ * @return int 1 if the block was deferred, 0 if it is too big for the quick
+ * lists and should be freed normally
+ */
+int quick_push(block_meta_t *block);
+
+/**
+ * @brief Take a block of exactly the needed size class from the quick lists
+ *
+ * @param size The size that should be allocated
+ * @return block_meta_t* The block, marked as allocated, or NULL if the quick
+ * list of the size class is empty
+ */
+block_meta_t *quick_pop(size_t size);
+
+/**
+ * @brief Mark all the blocks from the quick lists as free and merge them with
+ * their free neighbours. Called when an allocation misses, or when the
+ * lists grow too big
+ */
+void consolidate_quick(void);
+
 /**
  * @brief Merge a block with it's next neighbour, if possible
  * 
@@ -201,15 +280,72 @@ void merge_with_prev(block_meta_t *block);
  */
 void merge_free_blocks(block_meta_t *block);
 
+/**
+ * @brief Get the free heap block with whole pages inside that has been dirty
+ * the longest, the head of the heap's decay LRU
+ *
+ * @param epoch Set to the decay epoch the block got dirty in
+ * @return block_meta_t* The block, or NULL if no free block holds dirty pages
+ */
+block_meta_t *heap_oldest_dirty(uint32_t *epoch);
+
+/**
+ * @brief Take a free heap block found by heap_oldest_dirty out of the
+ * allocator's reach, marked as allocated, while it's inner pages are purged.
+ * The header and the page it lives on stay
+ *
+ * @param block The block
+ * @param ext Filled with the pages to purge
+ */
+void heap_take_dirty(block_meta_t *block, purge_extent_t *ext);
+
+/**
+ * @brief Give back a block taken by heap_take_dirty, once it is purged, and
+ * merge it with the neighbours that were freed in the meantime
+ *
+ * @param ext The extent filled by heap_take_dirty
+ */
+void heap_put_clean(purge_extent_t *ext);
+
+/**
+ * @brief Get the length of a mapped block's mapping: the colour offset, the
+ * header and the payload, only the payload pages for out of line headers, the
+ * power of two size of a buddy block, or the pages of a span
+ *
+ * @param block The mapped block
+ * @return size_t The length of the mapping
+ */
+size_t get_mapped_length(block_meta_t *block);
+
+/**
+ * @brief Get the start of a mapped block's mapping: the page the block is in,
+ * or the payload when the header is out of line
+ *
+ * @param block The mapped block
+ * @return void* The address returned by mmap for the block
+ */
+void *get_mapping_start(block_meta_t *block);
+
 /**
  * @brief Eliberates a block that contains memory allocated by mmap syscall.
- * It's a wrraper of munmap syscall, specialized on metablocks.
+ * It's a wrraper of munmap syscall, specialized on metablocks. An out of line
+ * header goes back to the header pool, a buddy block goes back to the buddy
+ * allocator and a span block to the span heap
  * 
  * @param block The block that should be freed.
  * @return int Return value of the munmap syscall.
  */
 int free_mmaped_block(block_meta_t *block);
 
+/**
+ * @brief Raise the mmap threshold to the raw size of a freed mapped block, if
+ * the dynamic threshold is enabled and the size is under it's upper limit.
+ * Buddy, span and long lived blocks are left out, they cost no syscall
+ *
+ * @param block The mapped block that is about to be freed
+ */
+void update_mmap_threshold(block_meta_t *block);
+
 /* Reallocation related functions */
 
 /**
@@ -226,7 +362,7 @@ block_meta_t *realloc_mapped_block(block_meta_t *block, size_t size);
  * obviously, the mmap syscall
  * 
  * @param block Old block that should be reallocated
- * @param size The new size (bigger than MMAP_THRESHOLD)
+ * @param size The new size (bigger than the mmap threshold)
  * @return block_meta_t* New block or NULL in case of allocation failures
  */
 block_meta_t *move_to_mmap_space(block_meta_t *block, size_t size);
@@ -242,6 +378,68 @@ block_meta_t *move_to_mmap_space(block_meta_t *block, size_t size);
  */
 block_meta_t *unite_blocks(block_meta_t *block, size_t size);
 
+/**
+ * @brief Get the capacity that should be given to a block that os_realloc
+ * grows again: the size plus 1 / 2^REALLOC_HEADROOM_SHIFT of it, without
+ * crossing the mmap threshold. The extra capacity is counted as headroom
+ *
+ * @param size The new size of the block
+ * @return size_t The payload capacity that should be allocated
+ */
+size_t growth_capacity(size_t size);
+
+/**
+ * @brief Split the unused capacity off the growing blocks, and merge it with
+ * the free blocks after them. Called before the heap grows
+ */
+void reclaim_headroom(void);
+
+/**
+ * @brief Resize a mapped block with mremap, which moves the pages instead of
+ * copying them. The registry is updated if the mapping moves. Out of line
+ * headers stay where they are, only the mapping moves. Buddy and span blocks
+ * are only resized in place
+ *
+ * @param block The mapped block
+ * @param size The new size for the block
+ * @return block_meta_t* The block at it's new address, or NULL on failure
+ */
+block_meta_t *remap_block(block_meta_t *block, size_t size);
+
+/**
+ * @brief Split a free block, keeping the free part at the start and giving
+ * the end of it to a new allocated block
+ *
+ * @param unused_block The free block that is split
+ * @param payload_size The size of the allocated block
+ * @return block_meta_t* The allocated block, placed after unused_block
+ */
+block_meta_t *split_block_high(block_meta_t *unused_block, size_t payload_size);
+
+/**
+ * @brief Take a free heap block for an allocation with a lifetime hint. Long
+ * lived blocks are taken from the lowest fitting free block, short lived ones
+ * from the end of the highest one, so the two kinds don't interleave
+ *
+ * @param size The size of the allocation
+ * @param long_lived 1 for long lived allocations, 0 for short lived ones
+ * @return block_meta_t* The allocated block, or NULL if no free block fits
+ */
+block_meta_t *place_by_lifetime(size_t size, int long_lived);
+
+/**
+ * @brief Expand a block downwards, into it's free predecessor, moving the
+ * payload to the start of the predecessor. The remaining space is split if
+ * it is at least split_threshold
+ *
+ * @param block The block that should be expanded
+ * @param size The new size for the block
+ * @param used Number of payload bytes that should be kept
+ * @return block_meta_t* The predecessor, that now holds the payload, or NULL
+ * if the two blocks together are too small
+ */
+block_meta_t *unite_with_prev(block_meta_t *block, size_t size, size_t used);
+
 /**
  * @brief Get a pointer to the memory that can be used from the block sent
  * as parameter
@@ -253,7 +451,8 @@ void *get_address_by_block(block_meta_t *block);
 
 /**
  * @brief Get a pointer to the block by sending as parameter it's related
- * memory zone pointer
+ * memory zone pointer. Page aligned addresses are first looked up in the
+ * registry, when the mapped headers may be out of line
  * 
  * @param addr Pointer to the memory zone
  * @return block_meta_t* The block that corresponds to the address
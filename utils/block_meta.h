@@ -3,6 +3,8 @@
 #pragma once
 
 #include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include "printf.h"
 
@@ -19,6 +21,7 @@
 struct block_meta  {
 	size_t size;
 	int status;
+	unsigned int flags;
 	struct block_meta *prev;
 	struct block_meta *next;
 };
@@ -35,6 +38,24 @@ typedef enum alloc_type alloc_type_t;
 #define STATUS_FREE   0
 #define STATUS_ALLOC  1
 #define STATUS_MAPPED 2
+#define STATUS_QUICK  3
+
+/* Block metadata flags. They live in the padding after status, so the
+ * structure keeps its 32 bytes
+ */
+#define BLOCK_FLAG_SAMPLED 0x1
+#define BLOCK_FLAG_GROWING 0x2	/* Last reallocation made the block bigger */
+#define BLOCK_FLAG_OUT_OF_LINE 0x4	/* Mapped block whose header isn't in the mapping */
+#define BLOCK_FLAG_BUDDY 0x8	/* Mapped block taken from the buddy allocator */
+#define BLOCK_FLAG_SPAN 0x10	/* Mapped block taken from the span heap */
+#define BLOCK_FLAG_DIRTY 0x20	/* Free heap block with memory that may be committed */
+#define BLOCK_FLAG_LRU 0x40	/* Dirty free heap block on the decay LRU */
+#define BLOCK_FLAG_LONG 0x80	/* Mapped block taken from the long lived heap */
+
+/* The header of an out of line mapped block comes from the header pool of
+ * mapped.h, and it's prev field holds the start of the mapping, which is also
+ * the page aligned payload
+ */
 
 /* Some defines imported from tests/snippets/test-utils.h */
 
@@ -47,7 +68,19 @@ typedef enum alloc_type alloc_type_t;
 #define MULT_KB			1024
 
 /* New defines */
-#define ALIGNMENT 8
+
+/* Payloads are aligned for any fundamental type (16 bytes on x86_64). Built
+ * with -DCACHE_LINE_ALIGN, every block starts on a cache line and the header
+ * takes a whole line, so payloads are cache line aligned as well
+ */
+#define CACHE_LINE_SIZE 64
+
+#ifdef CACHE_LINE_ALIGN
+#define ALIGNMENT ((size_t)CACHE_LINE_SIZE)
+#else
+#define ALIGNMENT _Alignof(max_align_t)
+#endif
+
 #define ALIGN(size) (((size) + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1))
 #define BLOCK_ALIGN ALIGN(sizeof(block_meta_t))
 
@@ -58,6 +91,25 @@ typedef enum alloc_type alloc_type_t;
 #define NOT_DONE 0
 
 #define PAGE_SIZE 4096
+#define PAGE_ALIGN(size) (((size) + (PAGE_SIZE - 1)) & ~(size_t)(PAGE_SIZE - 1))
+
+/* Largest payload of a block. Past it, the raw size of the block (and it's
+ * rounding to pages) would wrap around, and no mapping is that big anyway
+ */
+#define MAX_PAYLOAD_SIZE ((size_t)PTRDIFF_MAX - BLOCK_ALIGN - PAGE_SIZE)
+
+/* Deferred coalescing: freed heap blocks with a payload of at most
+ * QUICK_MAX_SIZE bytes are kept in per-size quick lists. While a block is
+ * STATUS_QUICK, it's size field holds the next block of the list
+ */
+#define QUICK_MAX_SIZE 512
+#define QUICK_BINS (QUICK_MAX_SIZE / ALIGNMENT + 1)
+#define QUICK_MAX_BYTES_DEFAULT (64 * 1024)
+
+/* A block that is grown again by os_realloc gets this much extra capacity,
+ * as a fraction of the new size (1 / 2^shift)
+ */
+#define REALLOC_HEADROOM_SHIFT 1
 
 
 
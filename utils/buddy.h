@@ -0,0 +1,106 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "block_meta.h"
+#include "decay.h"
+
+/* Block sizes handed out by the buddy allocator: 128 KiB to 32 MiB */
+#define BUDDY_MIN_ORDER 17
+#define BUDDY_MAX_ORDER 25
+#define BUDDY_ORDERS (BUDDY_MAX_ORDER - BUDDY_MIN_ORDER + 1)
+
+/* Each region holds two blocks of the biggest order */
+#define BUDDY_REGION_SIZE (2UL << BUDDY_MAX_ORDER)
+#define BUDDY_REGION_UNITS (BUDDY_REGION_SIZE >> BUDDY_MIN_ORDER)
+#define BUDDY_REGIONS 16
+
+/**
+ * @brief Buddy allocator status, enabled with OSMEM_BUDDY=1. Mapped blocks
+ * of BUDDY_MIN_ORDER to BUDDY_MAX_ORDER then come from a few reserved
+ * regions, instead of a mapping each
+ */
+extern int buddy_enabled;
+
+/**
+ * @brief Read OSMEM_BUDDY. Called once, when the library is loaded
+ */
+void buddy_init(void);
+
+/**
+ * @brief Check if a mapped block belongs to the buddy allocator range. Sizes
+ * of at most half the smallest block are left to mmap, they would waste
+ * more than they use
+ *
+ * @param raw_size Size of the block, header included
+ * @return int 1 if the block should come from the buddy allocator
+ */
+static inline int buddy_fits(size_t raw_size)
+{
+	return buddy_enabled && raw_size > (1UL << (BUDDY_MIN_ORDER - 1)) &&
+	       raw_size <= (1UL << BUDDY_MAX_ORDER);
+}
+
+/**
+ * @brief Take the smallest power of two block that holds raw_size bytes,
+ * splitting a bigger free block if needed. A new region is reserved when no
+ * free block is big enough
+ *
+ * @param raw_size Size of the block, header included
+ * @return void* Start of the block, or NULL if all the regions are taken
+ */
+void *buddy_alloc(size_t raw_size);
+
+/**
+ * @brief Give a block back, merging it with it's free buddies. A block that
+ * merges up to the biggest order gives it's pages back to the kernel, when
+ * decay is not enabled
+ *
+ * @param p Start of the block
+ * @param raw_size The size that was asked for the block
+ */
+void buddy_free(void *p, size_t raw_size);
+
+/**
+ * @brief Resize a block in place, if it's order still fits the new size and
+ * isn't more than twice as big as needed
+ *
+ * @param p Start of the block
+ * @param old_raw_size The size that was asked for the block
+ * @param new_raw_size The new size, header included
+ * @return int 0 if the block was resized, -1 if it has to move
+ */
+int buddy_resize(void *p, size_t old_raw_size, size_t new_raw_size);
+
+/**
+ * @brief Get the size of a buddy block
+ *
+ * @param p Start of the block
+ * @return size_t The power of two size of the block
+ */
+size_t buddy_block_size(void *p);
+
+/**
+ * @brief Get the age of the oldest free block that may hold committed pages
+ *
+ * @param epoch Set to the decay epoch the block got dirty in
+ * @return int 1 if there is a dirty free block, 0 otherwise
+ */
+int buddy_oldest_dirty(uint32_t *epoch);
+
+/**
+ * @brief Take the oldest dirty free block out of the free lists, for the
+ * purger. The first page keeps the free list links, it isn't purged
+ *
+ * @param ext Filled with the pages to purge
+ */
+void buddy_take_dirty(purge_extent_t *ext);
+
+/**
+ * @brief Give back a block taken by buddy_take_dirty, once it is purged
+ *
+ * @param ext The extent filled by buddy_take_dirty
+ */
+void buddy_put_clean(purge_extent_t *ext);
@@ -0,0 +1,133 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include <stddef.h>
+#include "block_meta.h"
+
+/* Upper bound of the dynamic mmap threshold, as in glibc (64 bit) */
+#define MMAP_THRESHOLD_CAP (32 * 1024 * 1024)
+
+/**
+ * @brief Current mmap threshold: blocks whose raw size is bigger are mapped,
+ * the others go on the heap. It starts at OSMEM_MMAP_THRESHOLD (by default
+ * MMAP_THRESHOLD)
+ */
+extern size_t mmap_threshold;
+
+/**
+ * @brief Upper limit of the dynamic mmap threshold, set by
+ * OSMEM_MMAP_THRESHOLD_MAX. When it is not above mmap_threshold, the
+ * threshold never changes
+ */
+extern size_t mmap_threshold_max;
+
+/* Bounds of the adaptive heap growth, when only one of them is set */
+#define HEAP_GROWTH_MIN_DEFAULT (16 * 1024)
+#define HEAP_GROWTH_MAX_DEFAULT (8 * 1024 * 1024)
+
+/**
+ * @brief Adaptive heap growth status. It is enabled by setting
+ * OSMEM_HEAP_PREALLOC_MIN or OSMEM_HEAP_PREALLOC_MAX; otherwise the heap is
+ * preallocated with HEAP_PREALLOCATION_SIZE and grows block by block
+ */
+extern int heap_adaptive;
+
+/**
+ * @brief Size of the first heap reservation (the floor, in adaptive mode)
+ */
+extern size_t heap_prealloc_size;
+
+/**
+ * @brief Floor and ceiling of the adaptive heap growth steps
+ */
+extern size_t heap_growth_min;
+extern size_t heap_growth_max;
+
+/**
+ * @brief Address space reserved for the main heap, set by
+ * OSMEM_HEAP_RESERVE (1 for HEAP_RESERVE_DEFAULT). When it is 0, the heap is
+ * grown with sbrk; otherwise it lives in a heap segment and only commits
+ * memory in big steps
+ */
+extern size_t heap_reserve;
+
+/**
+ * @brief Out of line headers for mapped blocks, enabled by
+ * OSMEM_PAGE_ALIGNED_MAPS=1. Mapped payloads are then page aligned, and the
+ * mappings are a whole number of pages
+ */
+extern int page_aligned_maps;
+
+/**
+ * @brief Cache colouring of the mapped blocks, enabled by
+ * OSMEM_CACHE_COLOR=1. Each new mapping puts it's block a rotating number of
+ * cache lines in, within the slack of it's last page, so same-size buffers
+ * don't start on the same cache sets. Page aligned payloads are not coloured
+ */
+extern int cache_color;
+
+/**
+ * @brief Deferred coalescing status, enabled by OSMEM_DEFER_COALESCE=1
+ */
+extern int defer_coalesce;
+
+/**
+ * @brief Bytes the quick lists may hold before they are consolidated
+ * (OSMEM_QUICK_MAX_BYTES)
+ */
+extern size_t quick_max_bytes;
+
+/* Placement policies used by find_best_block */
+#define PLACEMENT_BEST  0	/* Smallest fitting block */
+#define PLACEMENT_FIRST 1	/* Lowest fitting address */
+#define PLACEMENT_NEXT  2	/* First fit, from where the last search stopped */
+#define PLACEMENT_GOOD  3	/* First block within good_fit_percent of the size, else best */
+
+/* Build time defaults, e.g. make OPTIONS=-DPLACEMENT_DEFAULT=PLACEMENT_FIRST */
+#ifndef PLACEMENT_DEFAULT
+#define PLACEMENT_DEFAULT PLACEMENT_BEST
+#endif
+
+#ifndef GOOD_FIT_PERCENT_DEFAULT
+#define GOOD_FIT_PERCENT_DEFAULT 10
+#endif
+
+#ifndef SPLIT_THRESHOLD_DEFAULT
+#define SPLIT_THRESHOLD_DEFAULT MIN_SPACE
+#endif
+
+/**
+ * @brief Placement policy, one of the PLACEMENT_* values. Set at init time
+ * by OSMEM_PLACEMENT=best|first|next|good
+ */
+extern int placement_policy;
+
+/**
+ * @brief How much bigger than the request a block may be for the good fit
+ * policy to take it without looking further (OSMEM_GOOD_FIT_PERCENT)
+ */
+extern size_t good_fit_percent;
+
+/**
+ * @brief Smallest remainder, header included, for which a reused block is
+ * split (OSMEM_SPLIT_THRESHOLD). Smaller remainders stay with the block as
+ * slack. It is never under MIN_SPACE
+ */
+extern size_t split_threshold;
+
+/**
+ * @brief Read a size from the environment. The value can be suffixed with
+ * k, m or g
+ *
+ * @param name Name of the environment variable
+ * @param def Value returned when the variable is not set or invalid
+ * @return size_t The size in bytes
+ */
+size_t env_size(const char *name, size_t def);
+
+/**
+ * @brief Read the allocator tunables from the environment. Called once, when
+ * the library is loaded
+ */
+void config_init(void);
@@ -0,0 +1,102 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* The decay time is split in this many epochs, the purger wakes up once per
+ * epoch
+ */
+#define DECAY_EPOCHS 64
+
+/* Shortest epoch, so that a small decay time doesn't spin the purger: decay
+ * times under DECAY_EPOCHS milliseconds are rounded up
+ */
+#define DECAY_EPOCH_MIN_NS 1000000ULL
+
+/* Shapes of the decay curve */
+#define DECAY_SMOOTHSTEP 0
+#define DECAY_LINEAR     1
+
+/* Structure to hold a run of dirty free pages, taken out of it's allocator
+ * while the purger gives it's memory back
+ */
+struct purge_extent {
+	char *addr;		/* First page to purge */
+	size_t len;		/* Bytes to purge */
+	int source;		/* DECAY_SOURCE_* */
+	void *cookie;		/* Start of the free run, for the put back */
+	size_t run;		/* Size of the free run, in the source's units */
+};
+typedef struct purge_extent purge_extent_t;
+
+#define DECAY_SOURCE_SPAN  0
+#define DECAY_SOURCE_BUDDY 1
+#define DECAY_SOURCE_HEAP  2
+
+/**
+ * @brief Decay status, enabled by setting OSMEM_DECAY_MS. The free pages of
+ * the span heap and of the buddy allocator then keep their memory when they
+ * are freed, and a background thread gives it back to the kernel once it has
+ * been unused for about OSMEM_DECAY_MS milliseconds. The whole pages inside
+ * the free blocks of the heap are purged the same way. The pages freed in the
+ * last epochs may stay dirty by the decay curve, the oldest free runs are
+ * purged first until the others are under it
+ */
+extern int decay_enabled;
+
+/**
+ * @brief Lock taken by the public entry points while decay is enabled, and
+ * by the purger for it's bookkeeping, which takes constant time per run. The
+ * purging syscalls are made without it, so the allocator never waits for
+ * them
+ */
+extern pthread_mutex_t decay_mutex;
+
+/**
+ * @brief Current epoch number, the age stamp of the dirty runs
+ */
+extern uint32_t decay_epoch;
+
+/**
+ * @brief Read OSMEM_DECAY_MS, OSMEM_DECAY_CURVE (smoothstep or linear) and
+ * OSMEM_PURGE (dontneed or free), and start the purger if decay is enabled.
+ * Called once, when the library is loaded
+ */
+void decay_init(void);
+
+/**
+ * @brief Take the allocator lock, if decay is enabled
+ */
+static inline void decay_lock(void)
+{
+	if (decay_enabled)
+		pthread_mutex_lock(&decay_mutex);
+}
+
+/**
+ * @brief Release the allocator lock, if decay is enabled
+ */
+static inline void decay_unlock(void)
+{
+	if (decay_enabled)
+		pthread_mutex_unlock(&decay_mutex);
+}
+
+/**
+ * @brief Account pages that the user just gave back. They start the decay
+ * curve, the moves between free runs don't
+ *
+ * @param pages Number of pages freed
+ */
+void decay_freed(size_t pages);
+
+/**
+ * @brief Account dirty pages entering or leaving the free runs of a source
+ *
+ * @param pages Number of dirty pages
+ */
+void decay_dirty_add(size_t pages);
+void decay_dirty_sub(size_t pages);
@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include "block_meta.h"
+
+/* Version of the heap dump format, written in it's first line */
+#define HEAP_DUMP_VERSION 2
+
+/**
+ * @brief Write a map of the Memory List to a file descriptor. The output is
+ * line based, with space separated fields:
+ *
+ *   osmem-heap-dump <version>
+ *   layout <header size> <alignment>
+ *   heap <heap start address> <program break>
+ *   block <heap|mmap|long> <offset> <size> <raw size> <free|alloc|mapped|quick>
+ *
+ * The layout gives the space taken by a block header (BLOCK_ALIGN) and the
+ * payload alignment, both bigger when built with -DCACHE_LINE_ALIGN. Heap
+ * block offsets are relative to the heap start, mapped blocks and the blocks
+ * of the long lived heap get their address instead. The raw size is the payload space really owned by the
+ * block, which differs from size for truncated blocks. Quick blocks are free
+ * blocks whose coalescing was deferred. Only stack buffers are
+ * used, so the heap is not changed while it is inspected
+ *
+ * @param fd The file descriptor where the map is written
+ * @return int 0 on success, -1 if a write failed
+ */
+int heap_dump(int fd);
@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Search kernels, in the order they are preferred */
+#define FIT_SEARCH_SCALAR 0
+#define FIT_SEARCH_SSE41  1
+#define FIT_SEARCH_AVX2   2
+
+/**
+ * @brief Search a packed array of free sizes, where 0 marks the entries
+ * that are not candidates. It returns the first entry between need and
+ * good; otherwise, the smallest entry that is at least need, the first one
+ * if there are several. Best fit is good = need, first fit is
+ * good = UINT32_MAX
+ *
+ * @param sizes The packed sizes
+ * @param n Number of entries
+ * @param need Smallest size that fits, at least 1
+ * @param good Largest size that ends the search
+ * @return size_t Index of the chosen entry, or n if nothing fits
+ */
+typedef size_t (*fit_search_fn)(const uint32_t *sizes, size_t n, uint32_t need, uint32_t good);
+
+size_t fit_search_scalar(const uint32_t *sizes, size_t n, uint32_t need, uint32_t good);
+size_t fit_search_sse41(const uint32_t *sizes, size_t n, uint32_t need, uint32_t good);
+size_t fit_search_avx2(const uint32_t *sizes, size_t n, uint32_t need, uint32_t good);
+
+/**
+ * @brief The kernel picked by fit_search_init
+ */
+extern fit_search_fn fit_search;
+
+/**
+ * @brief Pick the widest kernel the CPU supports. OSMEM_FIT_SEARCH
+ * (scalar, sse4.1 or avx2) can ask for a narrower one
+ *
+ * @return int The FIT_SEARCH_* value of the chosen kernel
+ */
+int fit_search_init(void);
+
+/**
+ * @brief Get a kernel by it's FIT_SEARCH_* value
+ *
+ * @param kind The kernel
+ * @return fit_search_fn The kernel, or NULL if the CPU doesn't support it
+ */
+fit_search_fn fit_search_kernel(int kind);
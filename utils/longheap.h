@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include <stddef.h>
+#include "block_meta.h"
+
+/* Address space reserved for the long lived heap, and the step it grows with */
+#define LONG_HEAP_RESERVE (1UL << 30)
+#define LONG_GROW_SIZE (64 * 1024)
+
+/**
+ * @brief Take a block for a long lived allocation (OSMEM_HINT_LONG) from the
+ * long lived heap, a heap segment of it's own. The long lived blocks then
+ * never pin the memory freed by the short lived ones around them. They are
+ * mapped blocks with BLOCK_FLAG_LONG, placed first fit from the bottom of the
+ * segment, which grows by at least LONG_GROW_SIZE when none fits
+ *
+ * @param size The payload size
+ * @return block_meta_t* The block, or NULL if the segment can't be created
+ * or grown
+ */
+block_meta_t *long_alloc(size_t size);
+
+/**
+ * @brief Give a long lived block back, merging it with the free blocks around
+ * it. Once the last block is freed, the segment is destroyed
+ *
+ * @param block The block
+ */
+void long_free(block_meta_t *block);
+
+/**
+ * @brief Get the payload space owned by a long lived block, up to the next
+ * block or the end of the segment
+ *
+ * @param block The block
+ * @return size_t The capacity of the block
+ */
+size_t long_capacity(block_meta_t *block);
+
+/**
+ * @brief Iterate the blocks of the long lived heap, free ones included
+ *
+ * @param block The previous block, NULL to start from the bottom
+ * @return block_meta_t* The next block, NULL after the last one
+ */
+block_meta_t *long_next(block_meta_t *block);
@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include <stddef.h>
+#include "block_meta.h"
+
+/* Slots of the static table; it moves to a mapping twice as big when it
+ * gets 3/4 full
+ */
+#define MAPPED_INITIAL_SLOTS 1024
+
+/* Out of line headers are carved from mappings of this size */
+#define MAPPED_HEADER_CHUNK (64 * 1024)
+
+/**
+ * @brief Add a mapped block to the registry. Mapped blocks are kept in an
+ * open addressing hash set keyed by the start of their mapping, outside the
+ * Memory List, so the heap traversals never see them
+ *
+ * @param block The mapped block
+ */
+void mapped_insert(block_meta_t *block);
+
+/**
+ * @brief Remove a mapped block from the registry. The header is read to find
+ * the key, so it must be called before the mapping is unmapped or moved
+ *
+ * @param block The mapped block
+ */
+void mapped_remove(block_meta_t *block);
+
+/**
+ * @brief Find the block whose mapping starts at the given address. That is
+ * how the out of line headers are found from their payload
+ *
+ * @param addr Start of the mapping
+ * @return block_meta_t* The block, or NULL if no mapping starts there
+ */
+block_meta_t *mapped_find(void *addr);
+
+/**
+ * @brief Get a header for an out of line mapped block, from a pool that
+ * grows by MAPPED_HEADER_CHUNK
+ *
+ * @return block_meta_t* The header, or NULL if the pool can't grow
+ */
+block_meta_t *mapped_header_alloc(void);
+
+/**
+ * @brief Give an out of line header back to the pool
+ *
+ * @param block The header, whose block is no longer registered
+ */
+void mapped_header_free(block_meta_t *block);
+
+/**
+ * @brief Get the number of mapped blocks
+ *
+ * @return size_t The number of blocks in the registry
+ */
+size_t mapped_count(void);
+
+/**
+ * @brief Iterate over the mapped blocks, in no particular order. The
+ * registry must not change during the iteration
+ *
+ * @param cursor Iteration state, set to 0 before the first call
+ * @return block_meta_t* The next block, or NULL at the end
+ */
+block_meta_t *mapped_next(size_t *cursor);
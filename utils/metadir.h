@@ -0,0 +1,133 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "block_meta.h"
+
+/* Entries the directory arrays are mapped with, they double when full */
+#define METADIR_INITIAL_ENTRIES 4096
+
+/**
+ * @brief Metadata directory status, enabled with OSMEM_META_DIRECTORY=1.
+ * The directory mirrors every heap block, in address order, in dense
+ * arrays: the header offsets, the raw sizes and the statuses, plus the sizes
+ * of the free blocks packed for the searches. The block searches read only
+ * the arrays, with the SIMD kernels of fitsearch.h, instead of chasing the
+ * headers all over the heap
+ */
+extern int metadir_enabled;
+
+/**
+ * @brief Read the directory configuration from the environment. Called
+ * once, when the library is loaded
+ */
+void metadir_init(void);
+
+/**
+ * @brief Add a new heap block to the directory. It's status is read from
+ * the header, it's size follows from the address of the next block
+ *
+ * @param block The block, already linked in the Memory List
+ */
+void metadir_insert_block(block_meta_t *block);
+
+/**
+ * @brief Remove a heap block that was merged into it's predecessor
+ *
+ * @param block The block whose header is no longer used
+ */
+void metadir_remove_block(block_meta_t *block);
+
+/**
+ * @brief Copy the status of a heap block from it's header
+ *
+ * @param block The block whose status changed
+ */
+void metadir_update_block(block_meta_t *block);
+
+/**
+ * @brief Recompute the size of the last heap block, after the end of the
+ * heap moved
+ */
+void metadir_refresh_tail(void);
+
+/**
+ * @brief Get the first or the last heap block
+ *
+ * @return block_meta_t* The block, or NULL if there are no heap blocks
+ */
+block_meta_t *metadir_first(void);
+block_meta_t *metadir_last(void);
+
+/**
+ * @brief Search the free blocks in address order, with the policies of
+ * find_best_block
+ *
+ * @param size The payload size that has to fit
+ * @param good_size A fitting block up to this size ends the search
+ * @param first Return the first fitting block, whatever it's size
+ * @return block_meta_t* The chosen block, or NULL if nothing fits
+ */
+block_meta_t *metadir_find(size_t size, size_t good_size, int first);
+
+/**
+ * @brief Search the free blocks in address order, starting from a block and
+ * wrapping around once, for next fit
+ *
+ * @param size The payload size that has to fit
+ * @param start Where the search starts, NULL for the first block
+ * @return block_meta_t* The first fitting block, or NULL
+ */
+block_meta_t *metadir_find_from(size_t size, block_meta_t *start);
+
+/**
+ * @brief Search the free blocks from the end of the heap down
+ *
+ * @param size The payload size that has to fit
+ * @return block_meta_t* The highest fitting block, or NULL
+ */
+block_meta_t *metadir_find_last(size_t size);
+
+/**
+ * @brief Hook called when a heap block is linked in the Memory List
+ *
+ * @param block The new block
+ */
+static inline void metadir_insert(block_meta_t *block)
+{
+	if (__builtin_expect(metadir_enabled, 0))
+		metadir_insert_block(block);
+}
+
+/**
+ * @brief Hook called when a heap block is merged into it's predecessor
+ *
+ * @param block The block that disappears
+ */
+static inline void metadir_remove(block_meta_t *block)
+{
+	if (__builtin_expect(metadir_enabled, 0))
+		metadir_remove_block(block);
+}
+
+/**
+ * @brief Hook called when the status of a heap block changes
+ *
+ * @param block The block
+ */
+static inline void metadir_update(block_meta_t *block)
+{
+	if (__builtin_expect(metadir_enabled, 0))
+		metadir_update_block(block);
+}
+
+/**
+ * @brief Hook called when the end of the heap moves
+ */
+static inline void metadir_grown(void)
+{
+	if (__builtin_expect(metadir_enabled, 0))
+		metadir_refresh_tail();
+}
@@ -10,8 +10,138 @@
 #include "printf.h"
 #include "block_meta.h"
 #include "blck.h"
+#include "stats.h"
+#include "arena.h"
+#include "pool.h"
+
+/* Expected lifetimes, for os_malloc_hint */
+#define OSMEM_HINT_SHORT 0x1
+#define OSMEM_HINT_LONG  0x2
+#define OSMEM_HINT_HUGE  0x4
 
 void *os_malloc(size_t size);
 void os_free(void *ptr);
 void *os_calloc(size_t nmemb, size_t size);
 void *os_realloc(void *ptr, size_t size);
+
+/**
+ * @brief Allocate memory, placing it by it's expected lifetime. Long lived
+ * blocks come from a heap segment of their own (longheap.h), so they never
+ * pin the memory around them, and short lived ones from the top of the heap,
+ * next to the tail, where they coalesce together once freed. Huge blocks are
+ * always mapped, so they never pin the program break. Without a hint, it
+ * behaves like os_malloc
+ *
+ * @param size The size of the allocation
+ * @param hint One of OSMEM_HINT_SHORT, OSMEM_HINT_LONG or OSMEM_HINT_HUGE
+ * @return void* The allocated memory, freed with os_free
+ */
+void *os_malloc_hint(size_t size, int hint);
+
+/**
+ * @brief Write the live heap profile collected by the sampling profiler
+ * (enabled with OSMEM_PROF_SAMPLE) in pprof's legacy heap format
+ *
+ * @param path Where the profile should be written
+ * @return int 0 on success, -1 on failure (or if the profiler is disabled)
+ */
+int os_heap_profile_dump(const char *path);
+
+/**
+ * @brief Write a machine readable map of the Memory List (offset, size,
+ * status and kind of every block) to a file descriptor. The format is
+ * described in dump.h, and tools/heapmap.py renders it
+ *
+ * @param fd The file descriptor where the map is written
+ * @return int 0 on success, -1 on failure
+ */
+int os_heap_dump(int fd);
+
+/**
+ * @brief Get a snapshot of the allocator statistics: syscall counts, memory
+ * obtained from the kernel and the state of the dynamic mmap threshold
+ * (OSMEM_MMAP_THRESHOLD, OSMEM_MMAP_THRESHOLD_MAX)
+ *
+ * @param stats Where the statistics are copied
+ */
+void os_get_stats(os_mem_stats_t *stats);
+
+/**
+ * @brief Create a bump-pointer arena, for allocations that are all released
+ * together. The arena memory comes in chunks from os_malloc
+ *
+ * @param initial_size Size of the first chunk, 0 for ARENA_DEFAULT_SIZE
+ * @return os_arena_t* The new arena, or NULL on failure (ENOMEM for a size
+ *         too big to fit in a chunk)
+ */
+os_arena_t *os_arena_create(size_t initial_size);
+
+/**
+ * @brief Allocate memory from an arena. When the current chunk is full, a
+ * new one, twice as big, is added
+ *
+ * @param arena The arena
+ * @param size Number of bytes needed
+ * @param align Power of two alignment of the result, 0 for ALIGNMENT
+ * @return void* The memory, or NULL on failure (EINVAL for a bad alignment,
+ *         ENOMEM for a size too big to fit in a chunk)
+ */
+void *os_arena_alloc(os_arena_t *arena, size_t size, size_t align);
+
+/**
+ * @brief Release everything allocated from an arena. An arena that grew to
+ * several chunks gets a single chunk of their total size
+ *
+ * @param arena The arena
+ */
+void os_arena_reset(os_arena_t *arena);
+
+/**
+ * @brief Release an arena together with all it's chunks
+ *
+ * @param arena The arena, can be NULL
+ */
+void os_arena_destroy(os_arena_t *arena);
+
+/**
+ * @brief Create a pool of fixed size objects. The objects are carved from
+ * slabs of POOL_SLAB_SIZE bytes, taken with os_malloc, and have no header
+ *
+ * @param obj_size Size of the objects
+ * @param align Power of two alignment of the objects, 0 for ALIGNMENT
+ * @return os_pool_t* The new pool, or NULL on failure (EINVAL for a bad size
+ * or alignment, or objects that don't fit in a slab)
+ */
+os_pool_t *os_pool_create(size_t obj_size, size_t align);
+
+/**
+ * @brief Get an object from a pool: the last freed one, or a new one
+ *
+ * @param pool The pool
+ * @return void* The object, or NULL if a new slab couldn't be allocated
+ */
+void *os_pool_alloc(os_pool_t *pool);
+
+/**
+ * @brief Give an object back to the pool it was allocated from
+ *
+ * @param pool The pool
+ * @param obj The object, can be NULL
+ */
+void os_pool_free(os_pool_t *pool, void *obj);
+
+/**
+ * @brief Get the occupancy statistics of a pool
+ *
+ * @param pool The pool
+ * @param stats Where the statistics are copied
+ */
+void os_pool_get_stats(os_pool_t *pool, os_pool_stats_t *stats);
+
+/**
+ * @brief Release a pool together with all it's slabs. Objects still in use
+ * become invalid
+ *
+ * @param pool The pool, can be NULL
+ */
+void os_pool_destroy(os_pool_t *pool);
@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Size of the blocks a pool asks os_malloc for, kept under the default
+ * mmap threshold so that slabs come from the heap
+ */
+#define POOL_SLAB_SIZE (64 * 1024)
+
+/* Structure placed at the start of every pool slab, followed by the objects */
+struct os_pool_slab {
+	struct os_pool_slab *next;
+};
+typedef struct os_pool_slab os_pool_slab_t;
+
+/* Structure to hold the occupancy of a pool, returned by os_pool_get_stats */
+struct os_pool_stats {
+	size_t obj_size;	/* Object size, rounded up to the alignment */
+	size_t slabs;		/* Slabs taken from the allocator */
+	size_t capacity;	/* Objects that fit in the slabs */
+	size_t in_use;		/* Objects currently allocated */
+	size_t peak_in_use;
+	size_t allocs;
+	size_t frees;
+};
+typedef struct os_pool_stats os_pool_stats_t;
+
+/* Structure to hold a pool of fixed size objects. Free objects form a LIFO
+ * list, linked through their first word, so objects have no header
+ */
+struct os_pool {
+	void *free_list;	/* Last freed object */
+	char *next;		/* Never used part of the newest slab */
+	char *end;
+	size_t obj_size;
+	size_t align;
+	size_t per_slab;	/* Objects in one slab */
+	os_pool_slab_t *slabs;
+	os_pool_stats_t stats;
+};
+typedef struct os_pool os_pool_t;
@@ -0,0 +1,98 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "block_meta.h"
+
+/* Maximum number of return addresses stored for a sampled call stack */
+#define PROF_MAX_DEPTH 32
+
+/* Number of distinct call stacks the profiler can keep track of */
+#define PROF_BUCKETS 4096
+
+/* The bucket index of a sampled block is kept in bits 8-19 of it's flags
+ * field, the lower ones being reserved for the BLOCK_FLAG_* values
+ */
+#define PROF_BUCKET_SHIFT 8
+#define PROF_BUCKET_MASK ((unsigned int)(PROF_BUCKETS - 1) << PROF_BUCKET_SHIFT)
+
+/* Default mean sampling interval, when OSMEM_PROF_SAMPLE is set to 1 */
+#define PROF_DEFAULT_INTERVAL (512 * 1024)
+
+/* Structure to hold the statistics of a call stack */
+struct prof_bucket {
+	uint64_t hash;
+	int depth;
+	uintptr_t pcs[PROF_MAX_DEPTH];
+	size_t live_count;
+	size_t live_bytes;
+	size_t alloc_count;
+	size_t alloc_bytes;
+};
+typedef struct prof_bucket prof_bucket_t;
+
+/**
+ * @brief Bytes that can still be allocated until the next sample is taken.
+ * The allocation functions decrement it, and call prof_sample when it
+ * drops below zero
+ */
+extern ssize_t prof_bytes_left;
+
+/**
+ * @brief Read the profiler configuration from the environment. When
+ * OSMEM_PROF_SAMPLE is set, it maps the bucket table and arms the counter.
+ * Called once, when the library is loaded
+ */
+void prof_init(void);
+
+/**
+ * @brief Slow path of the sampling counter. It draws the next geometric
+ * interval and, if the profiler is enabled, records the call stack of the
+ * allocation. It also serves pending dump requests
+ *
+ * @param block The block that was just handed to the user
+ */
+void prof_sample(block_meta_t *block);
+
+/**
+ * @brief Remove a sampled block from the live heap profile. Called only on
+ * blocks that have the BLOCK_FLAG_SAMPLED flag set
+ *
+ * @param block The block that is about to be freed
+ */
+void prof_unsample(block_meta_t *block);
+
+/**
+ * @brief Write the live heap profile in the legacy pprof heap format
+ * (heap_v2), followed by the process mappings, so that pprof can symbolize it
+ *
+ * @param path Where the profile should be written
+ * @return int 0 on success, -1 on failure (errno is set)
+ */
+int prof_dump(const char *path);
+
+/**
+ * @brief Hook called by the allocation functions for every block they return
+ *
+ * @param block The allocated block
+ * @param size The size the user asked for
+ */
+static inline void prof_account_alloc(block_meta_t *block, size_t size)
+{
+	prof_bytes_left -= (ssize_t)size;
+	if (__builtin_expect(prof_bytes_left < 0, 0))
+		prof_sample(block);
+}
+
+/**
+ * @brief Hook called by os_free for every block that is about to be freed
+ *
+ * @param block The block that is freed
+ */
+static inline void prof_account_free(block_meta_t *block)
+{
+	if (__builtin_expect(block->flags & BLOCK_FLAG_SAMPLED, 0))
+		prof_unsample(block);
+}
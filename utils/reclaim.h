@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include <stddef.h>
+
+/* Once the reclaimer wakes up, it lets the frees gather for this long before
+ * it takes the batch
+ */
+#define RECLAIM_BATCH_NS 1000000L
+
+/* Bytes that may wait for the reclaimer, beyond that os_free unmaps itself */
+#define RECLAIM_MAX_PENDING (256UL * 1024 * 1024)
+
+/**
+ * @brief Asynchronous munmap status, enabled with OSMEM_ASYNC_MUNMAP=1. The
+ * mappings of the freed blocks are then queued to a background thread, that
+ * unmaps them in batches, so os_free doesn't wait for the TLB shootdowns
+ */
+extern int reclaim_enabled;
+
+/**
+ * @brief Read OSMEM_ASYNC_MUNMAP and start the reclaimer if it is set.
+ * Called once, when the library is loaded
+ */
+void reclaim_init(void);
+
+/**
+ * @brief Hand a mapping over to the reclaimer. The mapping is linked into a
+ * lock-free list through it's first bytes, so the call allocates nothing and
+ * takes constant time. When too much memory is already waiting, the mapping
+ * is unmapped right away
+ *
+ * @param start Start of the mapping, page aligned
+ * @param length Length of the mapping
+ * @return int 1 when queued, 0 when unmapped right away, -1 on munmap failure
+ */
+int reclaim_unmap(void *start, size_t length);
+
+/**
+ * @brief Reclaimer counters, for os_get_stats
+ *
+ * @param queued Set to the number of mappings handed over
+ * @param batches Set to the number of batches taken by the reclaimer
+ * @param unmaps Set to the number of munmap calls of the reclaimer
+ * @param waiting Set to the bytes still waiting to be unmapped
+ */
+void reclaim_stats(size_t *queued, size_t *batches, size_t *unmaps, size_t *waiting);
@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include <stddef.h>
+
+/* Number of heap segments that can exist at the same time */
+#define SEGMENT_MAX 16
+
+/* Reserved memory is made accessible in steps of this size, so that most
+ * of the heap expansions don't need a syscall
+ */
+#define SEGMENT_COMMIT_STEP (2 * 1024 * 1024)
+
+/* Address space reserved for the main heap, when OSMEM_HEAP_RESERVE=1 */
+#define HEAP_RESERVE_DEFAULT (64UL * 1024 * 1024 * 1024)
+
+/* Structure to hold a heap segment: a range of reserved addresses with a
+ * program break of it's own. The memory up to committed is accessible, the
+ * rest is PROT_NONE until the break gets there
+ */
+struct heap_segment {
+	char *base;		/* Start of the reservation, NULL if unused */
+	char *brk;		/* End of the memory handed out */
+	char *committed;	/* End of the accessible memory */
+	char *end;		/* End of the reservation */
+};
+typedef struct heap_segment heap_segment_t;
+
+/**
+ * @brief Reserve the addresses of a new segment, without committing any
+ * memory. The segments are independent of each other and of the program
+ * break, so every user can have it's own contiguous heap
+ *
+ * @param reserve Size of the address range, rounded up to whole pages
+ * @return heap_segment_t* The new segment, or NULL if there is no free
+ * segment slot or the addresses can't be reserved
+ */
+heap_segment_t *segment_create(size_t reserve);
+
+/**
+ * @brief Move the break of a segment up, committing the memory in
+ * SEGMENT_COMMIT_STEP steps. It works like sbrk, on the segment
+ *
+ * @param seg The segment
+ * @param increment Number of bytes to add
+ * @return void* The previous break, or MAP_FAILED if the reservation is
+ * exhausted or the memory can't be committed
+ */
+void *segment_sbrk(heap_segment_t *seg, size_t increment);
+
+/**
+ * @brief Unmap a segment and free it's slot
+ *
+ * @param seg The segment
+ */
+void segment_destroy(heap_segment_t *seg);
@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include <stdint.h>
+#include "block_meta.h"
+
+/* Number of (call site, size class) pairs the predictor can learn */
+#define SITE_TABLE_SIZE 4096
+
+/* The site index of a block is kept in bits 20-31 of it's flags field,
+ * above the heap profiler's bucket index
+ */
+#define SITE_SHIFT 20
+#define SITE_MASK ((unsigned int)(SITE_TABLE_SIZE - 1) << SITE_SHIFT)
+
+/* Allocations a site needs before it's lifetime is predicted */
+#define SITE_MIN_ALLOCS 64
+
+/* Predicted lifetimes, measured in allocations made by the whole program
+ * (the allocation clock): under SITE_SHORT_TICKS a site is short lived, over
+ * SITE_LONG_TICKS it is long lived, in between it is left alone
+ */
+#define SITE_SHORT_TICKS 1024
+#define SITE_LONG_TICKS (64 * 1024)
+
+/* Structure to hold what is known about one allocation site */
+struct site {
+	uintptr_t pc;		/* Return address of the allocation call */
+	unsigned int size_class;	/* Bit length of the size */
+	uint64_t first_tick;	/* Allocation clock at the first allocation */
+	uint64_t allocs;
+	uint64_t live;
+};
+typedef struct site site_t;
+
+/**
+ * @brief Prediction status, enabled with OSMEM_LIFETIME_PREDICT=1
+ */
+extern int site_enabled;
+
+/**
+ * @brief Read the predictor configuration from the environment, and map the
+ * site table if it is enabled. Called once, when the library is loaded
+ */
+void site_init(void);
+
+/**
+ * @brief Find the site of an allocation, adding it to the table if it is new
+ *
+ * @param pc The return address of the allocation call
+ * @param size The size of the allocation
+ * @return unsigned int The site index, or 0 if the table is full
+ */
+unsigned int site_lookup(uintptr_t pc, size_t size);
+
+/**
+ * @brief Predict the lifetime of the next allocation of a site. By Little's
+ * law, the mean lifetime is the number of live blocks divided by the rate at
+ * which the site allocates
+ *
+ * @param idx The site index
+ * @return int OSMEM_HINT_SHORT, OSMEM_HINT_LONG, or 0 if there is no
+ * prediction yet
+ */
+int site_predict(unsigned int idx);
+
+/**
+ * @brief Record a new block of a site, and store the site in the block
+ *
+ * @param block The allocated block
+ * @param idx The site index
+ */
+void site_account_alloc(block_meta_t *block, unsigned int idx);
+
+/**
+ * @brief Record the death of a block, if it belongs to a site
+ *
+ * @param block The block that is freed or reallocated
+ */
+void site_account_free(block_meta_t *block);
@@ -0,0 +1,87 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "block_meta.h"
+#include "decay.h"
+
+/* Blocks of more than a page, and up to this many pages, header included,
+ * come from the span heap
+ */
+#define SPAN_MAX_PAGES 32
+
+/* Address space reserved for the span heap, and the step it grows with */
+#define SPAN_HEAP_RESERVE (1UL << 30)
+#define SPAN_GROW_PAGES 256
+
+/* Free spans of at least this many pages give their memory back, unless the
+ * decay purger is there to do it
+ */
+#define SPAN_RELEASE_PAGES 64
+
+/**
+ * @brief Span heap status, enabled with OSMEM_SPAN_HEAP=1. Mid-size blocks
+ * then take whole pages from a heap of their own, instead of being split out
+ * of the Memory List among the small blocks
+ */
+extern int span_enabled;
+
+/**
+ * @brief Read OSMEM_SPAN_HEAP. Called once, when the library is loaded
+ */
+void span_init(void);
+
+/**
+ * @brief Check if a block belongs to the span heap range
+ *
+ * @param raw_size Size of the block, header included
+ * @return int 1 if the block should come from the span heap
+ */
+static inline int span_fits(size_t raw_size)
+{
+	return span_enabled && raw_size > PAGE_SIZE && raw_size <= SPAN_MAX_PAGES * PAGE_SIZE;
+}
+
+/**
+ * @brief Take a run of pages from the span heap: the smallest free span
+ * that is big enough, split at page granularity. The heap grows by at least
+ * SPAN_GROW_PAGES when no free span fits
+ *
+ * @param pages Number of pages
+ * @return void* Start of the span, or NULL if the reservation is exhausted
+ */
+void *span_alloc(size_t pages);
+
+/**
+ * @brief Give a span back, merging it with the free spans around it. A free
+ * span of SPAN_RELEASE_PAGES or more is decommitted whole, when decay is not
+ * enabled
+ *
+ * @param p Start of the span
+ */
+void span_free(void *p);
+
+/**
+ * @brief Get the age of the oldest free span that may hold committed pages
+ *
+ * @param epoch Set to the decay epoch the span got dirty in
+ * @return int 1 if there is a dirty free span, 0 otherwise
+ */
+int span_oldest_dirty(uint32_t *epoch);
+
+/**
+ * @brief Take the oldest dirty free span out of the free lists, for the
+ * purger. Only called when span_oldest_dirty found one
+ *
+ * @param ext Filled with the pages to purge
+ */
+void span_take_dirty(purge_extent_t *ext);
+
+/**
+ * @brief Give back a span taken by span_take_dirty, once it is purged
+ *
+ * @param ext The extent filled by span_take_dirty
+ */
+void span_put_clean(purge_extent_t *ext);
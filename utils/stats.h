@@ -0,0 +1,188 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include <stddef.h>
+
+/* Structure to hold the allocator statistics, returned by os_get_stats */
+struct os_mem_stats {
+	/* Syscalls made by the allocator */
+	size_t brk_calls;
+	size_t mmap_calls;
+	size_t munmap_calls;
+	size_t mremap_calls;
+
+	/* Memory obtained from the kernel */
+	size_t heap_bytes;
+	size_t mapped_bytes;
+	size_t peak_mapped_bytes;
+
+	/* Reserved heap segments */
+	size_t segment_reserves;
+	size_t commit_calls;
+	size_t reserved_bytes;
+	size_t committed_bytes;
+
+	/* Buddy allocator, OSMEM_BUDDY. The internal fragmentation is the part
+	 * of the blocks that wasn't asked for, computed by os_get_stats
+	 */
+	size_t buddy_regions;
+	size_t buddy_reserved_bytes;
+	size_t buddy_allocs;
+	size_t buddy_block_bytes;
+	size_t buddy_requested_bytes;
+	size_t buddy_internal_bytes;
+	size_t buddy_purges;
+
+	/* Span heap, OSMEM_SPAN_HEAP */
+	size_t span_heap_bytes;
+	size_t span_live_bytes;
+	size_t span_allocs;
+	size_t span_decommits;
+	size_t span_decommitted_bytes;
+
+	/* Decay of the dirty free pages, OSMEM_DECAY_MS. The dirty bytes are the
+	 * free span and buddy pages that may still be committed, the heap ones
+	 * are the whole pages inside the dirty free heap blocks
+	 */
+	size_t dirty_bytes;
+	size_t heap_dirty_bytes;
+	size_t purge_passes;
+	size_t purge_calls;
+	size_t purged_bytes;
+
+	/* Asynchronous munmap, OSMEM_ASYNC_MUNMAP, read by os_get_stats */
+	size_t async_unmaps;
+	size_t reclaim_batches;
+	size_t reclaim_munmaps;
+	size_t reclaim_pending_bytes;
+
+	/* Heap usage */
+	size_t heap_alloc_bytes;
+	size_t heap_live_bytes;
+	size_t peak_heap_live_bytes;
+	size_t heap_growth_step;
+
+	/* Reallocations that kept or moved the payload */
+	size_t realloc_in_place;
+	size_t realloc_moved;
+	size_t realloc_headroom_bytes;
+	size_t headroom_reclaims;
+
+	/* Allocations placed by os_malloc_hint */
+	size_t hint_short;
+	size_t hint_long;
+	size_t hint_huge;
+	size_t long_heap_bytes;
+	size_t long_live_bytes;
+
+	/* Lifetime prediction, OSMEM_LIFETIME_PREDICT */
+	size_t predicted_short;
+	size_t predicted_long;
+	size_t lifetime_sites;
+
+	/* Fragmentation and resident memory, computed by os_get_stats */
+	size_t heap_free_bytes;
+	size_t heap_free_blocks;
+	size_t heap_largest_free;
+	size_t rss_bytes;
+
+	/* Deferred coalescing */
+	size_t quick_frees;
+	size_t quick_hits;
+	size_t quick_consolidations;
+
+	/* Dynamic mmap threshold */
+	size_t mmap_threshold;
+	size_t mmap_threshold_max;
+	size_t mmap_threshold_updates;
+};
+typedef struct os_mem_stats os_mem_stats_t;
+
+/**
+ * @brief Global statistics, updated by the allocator
+ */
+extern os_mem_stats_t mem_stats;
+
+/**
+ * @brief Account a new mapping
+ *
+ * @param length Length of the mapping in bytes
+ */
+static inline void stats_mapped(size_t length)
+{
+	mem_stats.mmap_calls++;
+	mem_stats.mapped_bytes += length;
+	if (mem_stats.mapped_bytes > mem_stats.peak_mapped_bytes)
+		mem_stats.peak_mapped_bytes = mem_stats.mapped_bytes;
+}
+
+/**
+ * @brief Account a removed mapping
+ *
+ * @param length Length of the mapping in bytes
+ */
+static inline void stats_unmapped(size_t length)
+{
+	mem_stats.munmap_calls++;
+	mem_stats.mapped_bytes -= length;
+}
+
+/**
+ * @brief Account a mapping handed over to the reclaimer, that makes the
+ * munmap itself
+ *
+ * @param length Length of the mapping in bytes
+ */
+static inline void stats_unmap_queued(size_t length)
+{
+	mem_stats.mapped_bytes -= length;
+}
+
+/**
+ * @brief Account a resized mapping
+ *
+ * @param old_length Length of the mapping before
+ * @param new_length Length of the mapping after
+ */
+static inline void stats_remapped(size_t old_length, size_t new_length)
+{
+	mem_stats.mremap_calls++;
+	mem_stats.mapped_bytes += new_length - old_length;
+	if (mem_stats.mapped_bytes > mem_stats.peak_mapped_bytes)
+		mem_stats.peak_mapped_bytes = mem_stats.mapped_bytes;
+}
+
+/**
+ * @brief Account a heap expansion
+ *
+ * @param length Number of bytes the program break was moved with
+ */
+static inline void stats_heap_grown(size_t length)
+{
+	mem_stats.brk_calls++;
+	mem_stats.heap_bytes += length;
+}
+
+/**
+ * @brief Account a heap block handed to the user
+ *
+ * @param size The size of the block
+ */
+static inline void stats_heap_alloc(size_t size)
+{
+	mem_stats.heap_alloc_bytes += size;
+	mem_stats.heap_live_bytes += size;
+	if (mem_stats.heap_live_bytes > mem_stats.peak_heap_live_bytes)
+		mem_stats.peak_heap_live_bytes = mem_stats.heap_live_bytes;
+}
+
+/**
+ * @brief Account a heap block given back by the user
+ *
+ * @param size The size of the block
+ */
+static inline void stats_heap_free(size_t size)
+{
+	mem_stats.heap_live_bytes -= size;
+}
@@ -0,0 +1,77 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Trace file layout: a trace_header, followed by trace_rec entries */
+#define TRACE_MAGIC "OSMTRACE"
+#define TRACE_VERSION 1
+
+/* Size of the in-memory buffer, flushed to the file when full */
+#define TRACE_BUFFER_SIZE (1024 * 1024)
+
+/* Recorded operations */
+#define TRACE_OP_MALLOC  0
+#define TRACE_OP_CALLOC  1
+#define TRACE_OP_REALLOC 2
+#define TRACE_OP_FREE    3
+#define TRACE_OP_MALLOC_HINT 4
+
+/* Structure placed at the start of a trace file */
+struct trace_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t rec_size;
+};
+typedef struct trace_header trace_header_t;
+
+/* Structure to hold one recorded call. Pointers are recorded as they were
+ * returned by the allocator, the replayer uses them as ids: an address is
+ * unique as long as the block it names is alive
+ */
+struct trace_rec {
+	uint64_t ts;	/* Nanoseconds since the start of the recording */
+	uint32_t tid;	/* Thread that made the call */
+	uint32_t op;	/* One of the TRACE_OP_* values */
+	uint64_t ptr;	/* Input pointer (free, realloc), nmemb (calloc), or hint */
+	uint64_t size;	/* Requested size (element size for calloc) */
+	uint64_t ret;	/* Returned pointer */
+};
+typedef struct trace_rec trace_rec_t;
+
+/**
+ * @brief Recording status, set once at startup
+ */
+extern int trace_enabled;
+
+/**
+ * @brief Open the trace file named by OSMEM_TRACE_FILE, if it is set, and
+ * enable the recording. Called once, when the library is loaded
+ */
+void trace_init(void);
+
+/**
+ * @brief Get the current time of the monotonic clock
+ *
+ * @return uint64_t Time in nanoseconds
+ */
+uint64_t trace_now(void);
+
+/**
+ * @brief Append a call to the trace buffer, flushing it if it is full. The
+ * buffer is locked, so threads can record concurrently
+ *
+ * @param op The TRACE_OP_* value of the call
+ * @param start Time when the call started, as returned by trace_now
+ * @param ptr Input pointer of the call, nmemb for calloc, or the hint
+ * @param size The size argument of the call
+ * @param ret The pointer returned by the call
+ */
+void trace_record(uint32_t op, uint64_t start, uint64_t ptr, uint64_t size, void *ret);
+
+/**
+ * @brief Write the buffered records to the trace file. Called at exit
+ */
+void trace_flush(void);